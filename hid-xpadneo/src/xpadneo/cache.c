@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo per-controller state cache
+ *
+ * Remembers the resolved quirks and the last runtime state of recently seen
+ * controllers, keyed by MAC. A reconnect of the same controller with the same
+ * descriptor skips quirk parsing and heuristics, and gets back its profile,
+ * trigger scale and mouse mode. The cache is bounded and evicts the least
+ * recently used entry.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/atomic.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#include "xpadneo.h"
+
+/* number of controllers remembered at most */
+#define XPADNEO_CACHE_SIZE 16
+
+struct xpadneo_cache_entry {
+	struct list_head lru;
+	char uniq[64];
+
+	/* quirks are only valid for the same generation and fingerprint */
+	unsigned int generation;
+	unsigned int rsize;
+	u16 crc16;
+	u32 capabilities;
+	u32 quirks_detected;
+	u32 quirks;
+	bool quirks_valid;
+
+	/* runtime state of the last connection */
+	bool state_valid;
+	u8 profile;
+	u8 trigger_scale_left, trigger_scale_right;
+	u8 battery;
+	bool mouse_mode;
+};
+
+static DEFINE_MUTEX(cache_lock);
+static LIST_HEAD(cache_lru);
+static unsigned int cache_entries;
+static atomic_t cache_generation = ATOMIC_INIT(0);
+
+static u32 cache_capabilities(const struct xpadneo_devdata *xdata)
+{
+	return (xdata->capabilities.hw_profiles ? BIT(0) : 0)
+	    | (xdata->capabilities.paddles ? BIT(1) : 0)
+	    | (xdata->capabilities.share_button ? BIT(2) : 0);
+}
+
+/* called with the cache locked, moves a found entry to the front */
+static struct xpadneo_cache_entry *cache_find(const char *uniq)
+{
+	struct xpadneo_cache_entry *entry;
+
+	lockdep_assert_held(&cache_lock);
+
+	list_for_each_entry(entry, &cache_lru, lru) {
+		if (!strcmp(entry->uniq, uniq)) {
+			list_move(&entry->lru, &cache_lru);
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* called with the cache locked, evicts the least recently used entry if full */
+static struct xpadneo_cache_entry *cache_get(const char *uniq)
+{
+	struct xpadneo_cache_entry *entry = cache_find(uniq);
+
+	if (entry)
+		return entry;
+
+	if (cache_entries >= XPADNEO_CACHE_SIZE) {
+		entry = list_last_entry(&cache_lru, struct xpadneo_cache_entry, lru);
+		list_del(&entry->lru);
+		memset(entry, 0, sizeof(*entry));
+	} else {
+		entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry)
+			return NULL;
+		cache_entries++;
+	}
+
+	strscpy(entry->uniq, uniq, sizeof(entry->uniq));
+	list_add(&entry->lru, &cache_lru);
+	return entry;
+}
+
+/* drop all resolved quirks, e.g. after the quirks parameter changed */
+void xpadneo_cache_invalidate(void)
+{
+	atomic_inc(&cache_generation);
+}
+
+/*
+ * xpadneo_cache_get_quirks - look up the quirks resolved for a previous connection
+ *
+ * @detected: quirks detected before the quirks were resolved (device flags and
+ * descriptor fixups), part of the fingerprint
+ *
+ * Returns true and sets the resolved quirks if the controller is known with the
+ * same descriptor and capabilities, and the quirks parameter did not change.
+ */
+bool xpadneo_cache_get_quirks(struct xpadneo_devdata *xdata, u32 detected, u32 *quirks)
+{
+	const char *uniq = xdata->hdev->uniq;
+	struct xpadneo_cache_entry *entry;
+
+	if (!uniq[0])
+		return false;
+
+	guard(mutex)(&cache_lock);
+	entry = cache_find(uniq);
+	if (!entry || !entry->quirks_valid)
+		return false;
+
+	if ((entry->generation != atomic_read(&cache_generation))
+	    || (entry->rsize != xdata->original_rsize) || (entry->crc16 != xdata->original_crc16)
+	    || (entry->capabilities != cache_capabilities(xdata))
+	    || (entry->quirks_detected != detected)) {
+		entry->quirks_valid = false;
+		return false;
+	}
+
+	*quirks = entry->quirks;
+	return true;
+}
+
+void xpadneo_cache_put_quirks(struct xpadneo_devdata *xdata, u32 detected)
+{
+	const char *uniq = xdata->hdev->uniq;
+	struct xpadneo_cache_entry *entry;
+
+	if (!uniq[0])
+		return;
+
+	guard(mutex)(&cache_lock);
+	entry = cache_get(uniq);
+	if (!entry)
+		return;
+
+	entry->generation = atomic_read(&cache_generation);
+	entry->rsize = xdata->original_rsize;
+	entry->crc16 = xdata->original_crc16;
+	entry->capabilities = cache_capabilities(xdata);
+	entry->quirks_detected = detected;
+	entry->quirks = xdata->quirks;
+	entry->quirks_valid = true;
+}
+
+/* remember the runtime state of a disconnecting controller */
+void xpadneo_cache_put_state(struct xpadneo_devdata *xdata)
+{
+	const char *uniq = xdata->hdev->uniq;
+	struct xpadneo_cache_entry *entry;
+
+	if (!uniq[0])
+		return;
+
+	guard(mutex)(&cache_lock);
+	entry = cache_get(uniq);
+	if (!entry)
+		return;
+
+	entry->profile = xdata->profile;
+	entry->trigger_scale_left = xdata->trigger_scale.left;
+	entry->trigger_scale_right = xdata->trigger_scale.right;
+	entry->battery = xdata->battery.flags;
+	entry->mouse_mode = xdata->mouse_mode;
+	entry->state_valid = true;
+}
+
+/* restore the runtime state once all sub devices are initialized */
+void xpadneo_cache_restore_state(struct xpadneo_devdata *xdata)
+{
+	const char *uniq = xdata->hdev->uniq;
+	struct xpadneo_cache_entry *entry;
+	bool mouse_mode;
+
+	if (!uniq[0])
+		return;
+
+	scoped_guard(mutex, &cache_lock) {
+		entry = cache_find(uniq);
+		if (!entry || !entry->state_valid)
+			return;
+
+		/* controllers with hardware profiles report the profile themselves */
+		if (!xdata->capabilities.hw_profiles)
+			xdata->profile = entry->profile;
+
+		xdata->trigger_scale.left = entry->trigger_scale_left;
+		xdata->trigger_scale.right = entry->trigger_scale_right;
+
+		/* only a hint until the controller reports the battery again */
+		xdata->battery.flags = entry->battery;
+		mouse_mode = entry->mouse_mode;
+	}
+
+	hid_info(xdata->hdev, "restored profile %d and trigger modes from previous connection\n",
+		 xdata->profile);
+
+	if (mouse_mode && !xdata->mouse_mode)
+		xpadneo_mouse_toggle(xdata);
+}
+
+void xpadneo_cache_flush(void)
+{
+	struct xpadneo_cache_entry *entry, *tmp;
+
+	guard(mutex)(&cache_lock);
+	list_for_each_entry_safe(entry, tmp, &cache_lru, lru) {
+		list_del(&entry->lru);
+		kfree(entry);
+	}
+	cache_entries = 0;
+}
@@ -27,6 +27,38 @@
 #define timer_container_of(v, c, t) from_timer(v, c, t)
 #endif
 
+/* v6.13: hrtimer_setup() replaces hrtimer_init() */
+#if KERNEL_VERSION(6, 13, 0) > LINUX_VERSION_CODE
+static inline void hrtimer_setup(struct hrtimer *timer,
+				 enum hrtimer_restart (*function)(struct hrtimer *),
+				 clockid_t clock_id, enum hrtimer_mode mode)
+{
+	hrtimer_init(timer, clock_id, mode);
+	timer->function = function;
+}
+#endif
+
+/* v6.3: vm_flags must be changed through helpers */
+#if KERNEL_VERSION(6, 3, 0) > LINUX_VERSION_CODE
+static inline void vm_flags_clear(struct vm_area_struct *vma, unsigned long flags)
+{
+	vma->vm_flags &= ~flags;
+}
+#endif
+
+/* v6.3: the transport driver of HID devices became const */
+#if KERNEL_VERSION(6, 3, 0) > LINUX_VERSION_CODE
+#define xpadneo_ll_driver_ptr(p) ((struct hid_ll_driver *)(p))
+#else
+#define xpadneo_ll_driver_ptr(p) (p)
+#endif
+
+/* High-resolution wheel usage codes for kernel < 5.0 */
+#ifndef REL_WHEEL_HI_RES
+#define REL_WHEEL_HI_RES  0x0b
+#define REL_HWHEEL_HI_RES 0x0c
+#endif
+
 /* Profile usage code for kernel < 6.0-rc1 */
 #ifndef ABS_PROFILE
 #define ABS_PROFILE 0x21
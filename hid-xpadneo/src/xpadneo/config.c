@@ -0,0 +1,970 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo per-device configuration
+ *
+ * The module parameters provide the defaults for all devices, each device
+ * can override single settings via sysfs. Settings are compiled into an
+ * immutable config object which is published via RCU, so the hot paths only
+ * read precomputed values.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/device.h>
+#include <linux/err.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+
+#include "xpadneo.h"
+
+/* protects the device list and replacing the config objects */
+static DEFINE_MUTEX(config_lock);
+static LIST_HEAD(config_devices);
+
+static struct xpadneo_settings param_settings = {
+	.rumble_deadband = 3,
+	.rumble_report_rate = 30,
+	.shift_window = 200,
+	.mouse_report_rate = 250,
+	.mouse_deadzone = 3072,
+	.mouse_curve = "linear",
+	.stick_deadzone = 3072,
+	.stick_curve = "linear",
+	.axis_filter_min_cutoff = 1000,
+	.axis_filter_beta = 50,
+};
+
+static void config_refresh_all(void);
+
+/* numeric settings accept the same range as module parameter and sysfs attribute */
+struct config_param_range {
+	void *value;
+	u32 min, max;
+};
+
+static int config_parse_byte_range(const char *val, u8 *dst, u8 min, u8 max)
+{
+	u8 value;
+
+	if (kstrtou8(val, 10, &value))
+		return -EINVAL;
+
+	if ((value < min) || (value > max))
+		return -ERANGE;
+
+	*dst = value;
+	return 0;
+}
+
+static int config_parse_uint_range(const char *val, u32 *dst, u32 min, u32 max)
+{
+	u32 value;
+
+	if (kstrtou32(val, 10, &value))
+		return -EINVAL;
+
+	if ((value < min) || (value > max))
+		return -ERANGE;
+
+	*dst = value;
+	return 0;
+}
+
+static int config_param_set_byte_range(const char *val, const struct kernel_param *kp)
+{
+	const struct config_param_range *range = kp->arg;
+	int ret = config_parse_byte_range(val, range->value, range->min, range->max);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_param_get_byte_range(char *buffer, const struct kernel_param *kp)
+{
+	const struct config_param_range *range = kp->arg;
+
+	return scnprintf(buffer, PAGE_SIZE, "%u\n", *(u8 *)range->value);
+}
+
+static int config_param_set_uint_range(const char *val, const struct kernel_param *kp)
+{
+	const struct config_param_range *range = kp->arg;
+	int ret = config_parse_uint_range(val, range->value, range->min, range->max);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_param_get_uint_range(char *buffer, const struct kernel_param *kp)
+{
+	const struct config_param_range *range = kp->arg;
+
+	return scnprintf(buffer, PAGE_SIZE, "%u\n", *(u32 *)range->value);
+}
+
+static int config_param_set_bool(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_bool(val, kp);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_param_set_uint(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_parse_deadzone(const char *val, u16 *deadzone)
+{
+	u16 value;
+
+	if (kstrtou16(val, 10, &value))
+		return -EINVAL;
+
+	if (value >= XPADNEO_CURVE_MAX)
+		return -ERANGE;
+
+	*deadzone = value;
+	return 0;
+}
+
+static int config_param_set_deadzone(const char *val, const struct kernel_param *kp)
+{
+	int ret = config_parse_deadzone(val, kp->arg);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_parse_curve(const char *val, char *spec)
+{
+	struct xpadneo_curve *curve = xpadneo_curve_create(val, 0);
+
+	if (IS_ERR(curve))
+		return PTR_ERR(curve);
+
+	/* the curve keeps the trimmed spec */
+	strscpy(spec, curve->spec, XPADNEO_CURVE_SPEC_LEN);
+	kfree(curve);
+	return 0;
+}
+
+static int config_param_set_curve(const char *val, const struct kernel_param *kp)
+{
+	int ret = config_parse_curve(val, kp->arg);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_param_get_string(char *buffer, const struct kernel_param *kp)
+{
+	return scnprintf(buffer, PAGE_SIZE, "%s\n", (const char *)kp->arg);
+}
+
+static int config_parse_button_map(const char *val, char *spec)
+{
+	char buf[XPADNEO_REMAP_SPEC_LEN];
+	int ret = xpadneo_remap_compile(val, NULL);
+
+	if (ret)
+		return ret;
+
+	/* keep the trimmed spec */
+	strscpy(buf, val, sizeof(buf));
+	strscpy(spec, strim(buf), XPADNEO_REMAP_SPEC_LEN);
+	return 0;
+}
+
+static int config_param_set_button_map(const char *val, const struct kernel_param *kp)
+{
+	int ret = config_parse_button_map(val, kp->arg);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_parse_turbo_map(const char *val, char *spec)
+{
+	char buf[XPADNEO_TURBO_SPEC_LEN];
+	int ret = xpadneo_turbo_compile(val, NULL);
+
+	if (ret)
+		return ret;
+
+	/* keep the trimmed spec */
+	strscpy(buf, val, sizeof(buf));
+	strscpy(spec, strim(buf), XPADNEO_TURBO_SPEC_LEN);
+	return 0;
+}
+
+static int config_param_set_turbo_map(const char *val, const struct kernel_param *kp)
+{
+	int ret = config_parse_turbo_map(val, kp->arg);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_parse_attenuation(const char *val, u8 attenuation[2])
+{
+	char buf[16], *triggers;
+	u8 main = attenuation[0], extra = attenuation[1];
+
+	if (strscpy(buf, val, sizeof(buf)) < 0)
+		return -EINVAL;
+
+	/* a single value only changes the overall attenuation */
+	triggers = strchr(buf, ',');
+	if (triggers) {
+		*triggers++ = '\0';
+		if (kstrtou8(strim(triggers), 10, &extra))
+			return -EINVAL;
+	}
+
+	if (kstrtou8(strim(buf), 10, &main))
+		return -EINVAL;
+
+	attenuation[0] = main;
+	attenuation[1] = extra;
+	return 0;
+}
+
+/* parse "<both>" or "<left>,<right>" */
+static int config_parse_trigger_mode(const char *val, u8 mode[2])
+{
+	char buf[16], *right;
+	u8 left_mode, right_mode;
+
+	if (strscpy(buf, val, sizeof(buf)) < 0)
+		return -EINVAL;
+
+	right = strchr(buf, ',');
+	if (right)
+		*right++ = '\0';
+
+	if (kstrtou8(strim(buf), 10, &left_mode))
+		return -EINVAL;
+
+	right_mode = left_mode;
+	if (right && kstrtou8(strim(right), 10, &right_mode))
+		return -EINVAL;
+
+	if ((left_mode >= XBOX_TRIGGER_SCALE_NUM) || (right_mode >= XBOX_TRIGGER_SCALE_NUM))
+		return -ERANGE;
+
+	mode[0] = left_mode;
+	mode[1] = right_mode;
+	return 0;
+}
+
+static int config_param_set_trigger_mode(const char *val, const struct kernel_param *kp)
+{
+	int ret = config_parse_trigger_mode(val, kp->arg);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_param_set_attenuation(const char *val, const struct kernel_param *kp)
+{
+	int ret = config_parse_attenuation(val, kp->arg);
+
+	if (!ret)
+		config_refresh_all();
+
+	return ret;
+}
+
+static int config_param_get_byte_pair(char *buffer, const struct kernel_param *kp)
+{
+	const u8 *attenuation = kp->arg;
+
+	return scnprintf(buffer, PAGE_SIZE, "%u,%u\n", attenuation[0], attenuation[1]);
+}
+
+static const struct kernel_param_ops config_param_ops_byte_range = {
+	.set = config_param_set_byte_range,
+	.get = config_param_get_byte_range,
+};
+
+static const struct kernel_param_ops config_param_ops_uint_range = {
+	.set = config_param_set_uint_range,
+	.get = config_param_get_uint_range,
+};
+
+static const struct kernel_param_ops config_param_ops_bool = {
+	.set = config_param_set_bool,
+	.get = param_get_bool,
+};
+
+static const struct kernel_param_ops config_param_ops_uint = {
+	.set = config_param_set_uint,
+	.get = param_get_uint,
+};
+
+static const struct kernel_param_ops config_param_ops_attenuation = {
+	.set = config_param_set_attenuation,
+	.get = config_param_get_byte_pair,
+};
+
+static const struct kernel_param_ops config_param_ops_trigger_mode = {
+	.set = config_param_set_trigger_mode,
+	.get = config_param_get_byte_pair,
+};
+
+static const struct kernel_param_ops config_param_ops_deadzone = {
+	.set = config_param_set_deadzone,
+	.get = param_get_ushort,
+};
+
+static const struct kernel_param_ops config_param_ops_curve = {
+	.set = config_param_set_curve,
+	.get = config_param_get_string,
+};
+
+static const struct kernel_param_ops config_param_ops_button_map = {
+	.set = config_param_set_button_map,
+	.get = config_param_get_string,
+};
+
+static const struct kernel_param_ops config_param_ops_turbo_map = {
+	.set = config_param_set_turbo_map,
+	.get = config_param_get_string,
+};
+
+static struct config_param_range config_range_trigger_rumble_mode = {
+	&param_settings.trigger_rumble_mode, 0, PARAM_TRIGGER_RUMBLE_DISABLE
+};
+static struct config_param_range config_range_rumble_deadband = {
+	&param_settings.rumble_deadband, 0, 100
+};
+static struct config_param_range config_range_rumble_report_rate = {
+	&param_settings.rumble_report_rate, 0, XPADNEO_RUMBLE_REPORT_RATE_MAX
+};
+static struct config_param_range config_range_shift_window = {
+	&param_settings.shift_window, 0, XPADNEO_SHIFT_WINDOW_MAX
+};
+static struct config_param_range config_range_mouse_report_rate = {
+	&param_settings.mouse_report_rate, XPADNEO_MOUSE_REPORT_RATE_MIN,
+	XPADNEO_MOUSE_REPORT_RATE_MAX
+};
+static struct config_param_range config_range_stick_mode = {
+	&param_settings.stick_mode, 0, PARAM_STICK_MODE_SCALED_RADIAL
+};
+
+module_param_cb(trigger_rumble_mode, &config_param_ops_byte_range,
+		&config_range_trigger_rumble_mode, 0644);
+MODULE_PARM_DESC(trigger_rumble_mode, "(u8) Trigger rumble mode. 0: pressure, 2: disable.");
+
+module_param_cb(rumble_deadband, &config_param_ops_byte_range, &config_range_rumble_deadband,
+		0644);
+MODULE_PARM_DESC(rumble_deadband,
+		 "(u8) Smallest rumble strength change sent right away, smaller changes settle "
+		 "shortly after. 0 to 100.");
+
+module_param_cb(rumble_report_rate, &config_param_ops_uint_range,
+		&config_range_rumble_report_rate, 0644);
+MODULE_PARM_DESC(rumble_report_rate,
+		 "(uint) Rumble reports per second sent at most, after a short burst. "
+		 "0: unlimited, up to 1000.");
+
+module_param_cb(rumble_attenuation, &config_param_ops_attenuation,
+		param_settings.rumble_attenuation, 0644);
+MODULE_PARM_DESC(rumble_attenuation,
+		 "(u8) Attenuate the rumble strength: all[,triggers] "
+		 "0 (none, full rumble) to 100 (max, no rumble).");
+
+module_param_cb(disable_deadzones, &config_param_ops_bool,
+		&param_settings.disable_deadzones, 0644);
+MODULE_PARM_DESC(disable_deadzones,
+		 "(bool) Disable dead zone handling for raw processing by Wine/Proton, confuses joydev. "
+		 "0: disable, 1: enable.");
+
+module_param_cb(disable_shift_mode, &config_param_ops_bool,
+		&param_settings.disable_shift_mode, 0644);
+MODULE_PARM_DESC(disable_shift_mode,
+		 "(bool) Disable use Xbox logo button as shift. Will prohibit profile switching when enabled. "
+		 "0: disable, 1: enable.");
+
+module_param_cb(shift_window, &config_param_ops_uint_range, &config_range_shift_window, 0644);
+MODULE_PARM_DESC(shift_window,
+		 "(uint) Report the Xbox logo button press if no profile or mouse chord follows "
+		 "within this many ms. 0: report on release. Up to 1000.");
+
+module_param_cb(trigger_mode, &config_param_ops_trigger_mode, param_settings.trigger_mode, 0644);
+MODULE_PARM_DESC(trigger_mode,
+		 "(u8) Trigger mode: both or left,right. 0: full range, 1: half range (full output at "
+		 "half travel), 2: digital (0 or full output).");
+
+module_param_cb(mouse_report_rate, &config_param_ops_uint_range,
+		&config_range_mouse_report_rate, 0644);
+MODULE_PARM_DESC(mouse_report_rate,
+		 "(uint) Mouse mode report rate in Hz while the sticks are deflected. 50 to 1000.");
+
+module_param_cb(mouse_deadzone, &config_param_ops_deadzone, &param_settings.mouse_deadzone, 0644);
+MODULE_PARM_DESC(mouse_deadzone, "(u16) Dead zone of the sticks in mouse mode. 0 to 32767.");
+
+module_param_cb(mouse_curve, &config_param_ops_curve, param_settings.mouse_curve, 0644);
+MODULE_PARM_DESC(mouse_curve,
+		 "(string) Response curve of pointer and wheel speed in mouse mode. "
+		 "linear, power <exponent>, or points <x:y> ...");
+
+module_param_cb(stick_mode, &config_param_ops_byte_range, &config_range_stick_mode, 0644);
+MODULE_PARM_DESC(stick_mode,
+		 "(u8) Thumb stick processing. 0: off, 1: radial dead zone, "
+		 "2: scaled radial dead zone.");
+
+module_param_cb(stick_deadzone, &config_param_ops_deadzone,
+		&param_settings.stick_deadzone, 0644);
+MODULE_PARM_DESC(stick_deadzone,
+		 "(u16) Radial dead zone of the thumb stick processing. 0 to 32767.");
+
+module_param_cb(stick_anti_deadzone, &config_param_ops_deadzone,
+		&param_settings.stick_anti_deadzone, 0644);
+MODULE_PARM_DESC(stick_anti_deadzone,
+		 "(u16) Minimum output outside of the dead zone of the thumb stick processing. "
+		 "0 to 32767.");
+
+module_param_cb(stick_curve, &config_param_ops_curve, param_settings.stick_curve, 0644);
+MODULE_PARM_DESC(stick_curve,
+		 "(string) Response curve of the thumb stick processing. "
+		 "linear, power <exponent>, or points <x:y> ...");
+
+module_param_cb(axis_filter, &config_param_ops_bool, &param_settings.axis_filter, 0644);
+MODULE_PARM_DESC(axis_filter,
+		 "(bool) Adaptive jitter filter for sticks and triggers. 0: disable, 1: enable.");
+
+module_param_cb(axis_filter_min_cutoff, &config_param_ops_uint,
+		&param_settings.axis_filter_min_cutoff, 0644);
+MODULE_PARM_DESC(axis_filter_min_cutoff,
+		 "(uint) Jitter filter cutoff frequency at rest in mHz. Lower removes more noise.");
+
+module_param_cb(axis_filter_beta, &config_param_ops_uint, &param_settings.axis_filter_beta, 0644);
+MODULE_PARM_DESC(axis_filter_beta,
+		 "(uint) Jitter filter cutoff increase in mHz per stick unit/ms. Higher reduces lag.");
+
+module_param_cb(button_map, &config_param_ops_button_map, param_settings.button_map, 0644);
+MODULE_PARM_DESC(button_map,
+		 "(string) Button maps per profile: <profile>:<from>=<to>[,...] ..., "
+		 "buttons a, b, x, y, lb, rb, back, menu, ls, rs.");
+
+module_param_cb(turbo_map, &config_param_ops_turbo_map, param_settings.turbo_map, 0644);
+MODULE_PARM_DESC(turbo_map,
+		 "(string) Turbo buttons and macros per profile: <profile>:<button>[@<rate>][,...] "
+		 "or <profile>:<button>=<button>[+...][@<rate>][,...] ..., rate 1 to 50 Hz.");
+
+static int config_compile_sticks(struct xpadneo_config *config)
+{
+	const struct xpadneo_settings *settings = &config->settings;
+	u32 deadzone = settings->stick_deadzone, anti = settings->stick_anti_deadzone;
+	struct xpadneo_curve *curve;
+
+	if (settings->stick_mode == PARAM_STICK_MODE_OFF)
+		return 0;
+
+	/* only the scaled radial dead zone stretches the remaining range to full scale */
+	curve = xpadneo_curve_create(settings->stick_curve,
+				     settings->stick_mode == PARAM_STICK_MODE_SCALED_RADIAL
+				     ? deadzone : 0);
+	if (IS_ERR(curve))
+		return PTR_ERR(curve);
+
+	for (int i = 0; i <= XPADNEO_CURVE_SIZE; i++) {
+		u32 magnitude = min_t(u32, i << XPADNEO_CURVE_SHIFT, XPADNEO_CURVE_MAX);
+		u32 value = curve->lut[i];
+
+		/* the output starts at the anti dead zone outside of the dead zone */
+		if (magnitude < deadzone)
+			value = 0;
+		else
+			value = anti + value * (XPADNEO_CURVE_MAX - anti) / XPADNEO_CURVE_MAX;
+
+		config->stick_lut[i] = min_t(u32, value, XPADNEO_CURVE_MAX);
+	}
+
+	kfree(curve);
+	return 0;
+}
+
+static int config_compile_mouse(struct xpadneo_config *config)
+{
+	const struct xpadneo_settings *settings = &config->settings;
+	struct xpadneo_curve *curve;
+
+	/* the dead zone is stretched away before applying the curve */
+	curve = xpadneo_curve_create(settings->mouse_curve, settings->mouse_deadzone);
+	if (IS_ERR(curve))
+		return PTR_ERR(curve);
+
+	memcpy(config->mouse_lut, curve->lut, sizeof(config->mouse_lut));
+	kfree(curve);
+	return 0;
+}
+
+static int config_compile(struct xpadneo_config *config)
+{
+	const struct xpadneo_settings *settings = &config->settings;
+	u32 percent_main, percent_triggers, rate;
+	int ret;
+
+	if (settings->trigger_rumble_mode == PARAM_TRIGGER_RUMBLE_RESERVED)
+		pr_warn_once("hid-xpadneo trigger_rumble_mode=1 is unknown, defaulting to 0\n");
+
+	/* calculate the rumble attenuation */
+	percent_main = 100 - min_t(u32, settings->rumble_attenuation[0], 100);
+	percent_triggers = 100 - min_t(u32, settings->rumble_attenuation[1], 100);
+	percent_triggers = percent_triggers * percent_main / 100;
+
+	if (settings->trigger_rumble_mode == PARAM_TRIGGER_RUMBLE_DISABLE)
+		percent_triggers = 0;
+
+	/* scale 16 bit magnitudes to 0..100, triggers additionally by pressure 0..1023 */
+	config->rumble_main_scale = div_u64((u64)percent_main << 32, U16_MAX);
+	config->rumble_trigger_scale = div_u64((u64)percent_triggers << 32, U16_MAX * 1023);
+
+	/* magnitudes are 0..100 after scaling, so is the dead band */
+	config->rumble_deadband = min_t(u8, settings->rumble_deadband, 100);
+	rate = min_t(u32, settings->rumble_report_rate, XPADNEO_RUMBLE_REPORT_RATE_MAX);
+	config->rumble_interval = rate ? ns_to_ktime(NSEC_PER_SEC / rate) : 0;
+
+	rate = clamp_t(u32, settings->mouse_report_rate,
+		       XPADNEO_MOUSE_REPORT_RATE_MIN, XPADNEO_MOUSE_REPORT_RATE_MAX);
+	config->shift_window =
+	    ms_to_ktime(min_t(u32, settings->shift_window, XPADNEO_SHIFT_WINDOW_MAX));
+
+	config->mouse_rate = rate;
+	config->mouse_period = ns_to_ktime(NSEC_PER_SEC / rate);
+
+	ret = xpadneo_remap_compile(settings->button_map, &config->button_remap);
+	if (ret)
+		return ret;
+
+	ret = xpadneo_turbo_compile(settings->turbo_map, &config->turbo);
+	if (ret)
+		return ret;
+
+	ret = config_compile_mouse(config);
+	if (ret)
+		return ret;
+
+	return config_compile_sticks(config);
+}
+
+static int config_publish(struct xpadneo_devdata *xdata, const struct xpadneo_settings *settings,
+			  unsigned long overrides)
+{
+	struct xpadneo_config *config, *old;
+	bool disabled;
+	int ret;
+
+	config = kzalloc(sizeof(*config), GFP_KERNEL);
+	if (!config)
+		return -ENOMEM;
+
+	config->settings = *settings;
+	config->overrides = overrides;
+	ret = config_compile(config);
+	if (ret) {
+		kfree(config);
+		return ret;
+	}
+
+	old = rcu_dereference_protected(xdata->config, lockdep_is_held(&config_lock));
+	rcu_assign_pointer(xdata->config, config);
+
+	/* the dead zone is exposed as flat value of the gamepad axes */
+	disabled = xpadneo_config_flat_disabled(settings);
+	if (!old || (xpadneo_config_flat_disabled(&old->settings) != disabled))
+		xpadneo_events_update_deadzones(xdata, disabled);
+
+	if (old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
+static void config_copy_field(struct xpadneo_settings *dst, const struct xpadneo_settings *src,
+			      enum xpadneo_config_field field)
+{
+	switch (field) {
+	case XPADNEO_CONFIG_RUMBLE_ATTENUATION:
+		dst->rumble_attenuation[0] = src->rumble_attenuation[0];
+		dst->rumble_attenuation[1] = src->rumble_attenuation[1];
+		break;
+	case XPADNEO_CONFIG_TRIGGER_RUMBLE_MODE:
+		dst->trigger_rumble_mode = src->trigger_rumble_mode;
+		break;
+	case XPADNEO_CONFIG_RUMBLE_DEADBAND:
+		dst->rumble_deadband = src->rumble_deadband;
+		break;
+	case XPADNEO_CONFIG_RUMBLE_REPORT_RATE:
+		dst->rumble_report_rate = src->rumble_report_rate;
+		break;
+	case XPADNEO_CONFIG_DISABLE_DEADZONES:
+		dst->disable_deadzones = src->disable_deadzones;
+		break;
+	case XPADNEO_CONFIG_DISABLE_SHIFT_MODE:
+		dst->disable_shift_mode = src->disable_shift_mode;
+		break;
+	case XPADNEO_CONFIG_SHIFT_WINDOW:
+		dst->shift_window = src->shift_window;
+		break;
+	case XPADNEO_CONFIG_TRIGGER_MODE:
+		dst->trigger_mode[0] = src->trigger_mode[0];
+		dst->trigger_mode[1] = src->trigger_mode[1];
+		break;
+	case XPADNEO_CONFIG_MOUSE_REPORT_RATE:
+		dst->mouse_report_rate = src->mouse_report_rate;
+		break;
+	case XPADNEO_CONFIG_MOUSE_DEADZONE:
+		dst->mouse_deadzone = src->mouse_deadzone;
+		break;
+	case XPADNEO_CONFIG_MOUSE_CURVE:
+		strscpy(dst->mouse_curve, src->mouse_curve, sizeof(dst->mouse_curve));
+		break;
+	case XPADNEO_CONFIG_STICK_MODE:
+		dst->stick_mode = src->stick_mode;
+		break;
+	case XPADNEO_CONFIG_STICK_DEADZONE:
+		dst->stick_deadzone = src->stick_deadzone;
+		break;
+	case XPADNEO_CONFIG_STICK_ANTI_DEADZONE:
+		dst->stick_anti_deadzone = src->stick_anti_deadzone;
+		break;
+	case XPADNEO_CONFIG_STICK_CURVE:
+		strscpy(dst->stick_curve, src->stick_curve, sizeof(dst->stick_curve));
+		break;
+	case XPADNEO_CONFIG_AXIS_FILTER:
+		dst->axis_filter = src->axis_filter;
+		break;
+	case XPADNEO_CONFIG_AXIS_FILTER_MIN_CUTOFF:
+		dst->axis_filter_min_cutoff = src->axis_filter_min_cutoff;
+		break;
+	case XPADNEO_CONFIG_AXIS_FILTER_BETA:
+		dst->axis_filter_beta = src->axis_filter_beta;
+		break;
+	case XPADNEO_CONFIG_BUTTON_MAP:
+		strscpy(dst->button_map, src->button_map, sizeof(dst->button_map));
+		break;
+	case XPADNEO_CONFIG_TURBO_MAP:
+		strscpy(dst->turbo_map, src->turbo_map, sizeof(dst->turbo_map));
+		break;
+	default:
+		break;
+	}
+}
+
+/* called with the module parameters locked after changing a default */
+static void config_refresh_all(void)
+{
+	struct xpadneo_devdata *xdata;
+
+	guard(mutex)(&config_lock);
+	list_for_each_entry(xdata, &config_devices, config_node) {
+		const struct xpadneo_config *old =
+		    rcu_dereference_protected(xdata->config, lockdep_is_held(&config_lock));
+		struct xpadneo_settings settings = param_settings;
+		unsigned long field;
+
+		/* keep the settings overridden per device */
+		for_each_set_bit(field, &old->overrides, XPADNEO_CONFIG_FIELD_NUM)
+			config_copy_field(&settings, &old->settings, field);
+
+		if (config_publish(xdata, &settings, old->overrides))
+			hid_err(xdata->hdev, "failed to apply changed module parameters\n");
+	}
+}
+
+static ssize_t config_show(struct device *dev, char *buf, enum xpadneo_config_field field)
+{
+	struct xpadneo_devdata *xdata = to_xpadneo_devdata(dev);
+	const struct xpadneo_settings *settings;
+	ssize_t len = 0;
+
+	rcu_read_lock();
+	settings = &rcu_dereference(xdata->config)->settings;
+	switch (field) {
+	case XPADNEO_CONFIG_RUMBLE_ATTENUATION:
+		len = scnprintf(buf, PAGE_SIZE, "%u,%u\n", settings->rumble_attenuation[0],
+				settings->rumble_attenuation[1]);
+		break;
+	case XPADNEO_CONFIG_TRIGGER_RUMBLE_MODE:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->trigger_rumble_mode);
+		break;
+	case XPADNEO_CONFIG_RUMBLE_DEADBAND:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->rumble_deadband);
+		break;
+	case XPADNEO_CONFIG_RUMBLE_REPORT_RATE:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->rumble_report_rate);
+		break;
+	case XPADNEO_CONFIG_DISABLE_DEADZONES:
+		len = scnprintf(buf, PAGE_SIZE, "%d\n", settings->disable_deadzones);
+		break;
+	case XPADNEO_CONFIG_DISABLE_SHIFT_MODE:
+		len = scnprintf(buf, PAGE_SIZE, "%d\n", settings->disable_shift_mode);
+		break;
+	case XPADNEO_CONFIG_SHIFT_WINDOW:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->shift_window);
+		break;
+	case XPADNEO_CONFIG_TRIGGER_MODE:
+		len = scnprintf(buf, PAGE_SIZE, "%u,%u\n", settings->trigger_mode[0],
+				settings->trigger_mode[1]);
+		break;
+	case XPADNEO_CONFIG_MOUSE_REPORT_RATE:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->mouse_report_rate);
+		break;
+	case XPADNEO_CONFIG_MOUSE_DEADZONE:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->mouse_deadzone);
+		break;
+	case XPADNEO_CONFIG_MOUSE_CURVE:
+		len = scnprintf(buf, PAGE_SIZE, "%s\n", settings->mouse_curve);
+		break;
+	case XPADNEO_CONFIG_STICK_MODE:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->stick_mode);
+		break;
+	case XPADNEO_CONFIG_STICK_DEADZONE:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->stick_deadzone);
+		break;
+	case XPADNEO_CONFIG_STICK_ANTI_DEADZONE:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->stick_anti_deadzone);
+		break;
+	case XPADNEO_CONFIG_STICK_CURVE:
+		len = scnprintf(buf, PAGE_SIZE, "%s\n", settings->stick_curve);
+		break;
+	case XPADNEO_CONFIG_AXIS_FILTER:
+		len = scnprintf(buf, PAGE_SIZE, "%d\n", settings->axis_filter);
+		break;
+	case XPADNEO_CONFIG_AXIS_FILTER_MIN_CUTOFF:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->axis_filter_min_cutoff);
+		break;
+	case XPADNEO_CONFIG_AXIS_FILTER_BETA:
+		len = scnprintf(buf, PAGE_SIZE, "%u\n", settings->axis_filter_beta);
+		break;
+	case XPADNEO_CONFIG_BUTTON_MAP:
+		len = scnprintf(buf, PAGE_SIZE, "%s\n", settings->button_map);
+		break;
+	case XPADNEO_CONFIG_TURBO_MAP:
+		len = scnprintf(buf, PAGE_SIZE, "%s\n", settings->turbo_map);
+		break;
+	default:
+		break;
+	}
+	rcu_read_unlock();
+
+	return len;
+}
+
+static int config_parse_field(struct xpadneo_settings *settings, const char *buf,
+			      enum xpadneo_config_field field)
+{
+	switch (field) {
+	case XPADNEO_CONFIG_RUMBLE_ATTENUATION:
+		return config_parse_attenuation(buf, settings->rumble_attenuation);
+	case XPADNEO_CONFIG_TRIGGER_RUMBLE_MODE:
+		return config_parse_byte_range(buf, &settings->trigger_rumble_mode,
+					       0, PARAM_TRIGGER_RUMBLE_DISABLE);
+	case XPADNEO_CONFIG_RUMBLE_DEADBAND:
+		return config_parse_byte_range(buf, &settings->rumble_deadband, 0, 100);
+	case XPADNEO_CONFIG_RUMBLE_REPORT_RATE:
+		return config_parse_uint_range(buf, &settings->rumble_report_rate,
+					       0, XPADNEO_RUMBLE_REPORT_RATE_MAX);
+	case XPADNEO_CONFIG_DISABLE_DEADZONES:
+		return kstrtobool(buf, &settings->disable_deadzones);
+	case XPADNEO_CONFIG_DISABLE_SHIFT_MODE:
+		return kstrtobool(buf, &settings->disable_shift_mode);
+	case XPADNEO_CONFIG_SHIFT_WINDOW:
+		return config_parse_uint_range(buf, &settings->shift_window,
+					       0, XPADNEO_SHIFT_WINDOW_MAX);
+	case XPADNEO_CONFIG_TRIGGER_MODE:
+		return config_parse_trigger_mode(buf, settings->trigger_mode);
+	case XPADNEO_CONFIG_MOUSE_REPORT_RATE:
+		return config_parse_uint_range(buf, &settings->mouse_report_rate,
+					       XPADNEO_MOUSE_REPORT_RATE_MIN,
+					       XPADNEO_MOUSE_REPORT_RATE_MAX);
+	case XPADNEO_CONFIG_MOUSE_DEADZONE:
+		return config_parse_deadzone(buf, &settings->mouse_deadzone);
+	case XPADNEO_CONFIG_MOUSE_CURVE:
+		return config_parse_curve(buf, settings->mouse_curve);
+	case XPADNEO_CONFIG_STICK_MODE:
+		return config_parse_byte_range(buf, &settings->stick_mode,
+					       0, PARAM_STICK_MODE_SCALED_RADIAL);
+	case XPADNEO_CONFIG_STICK_DEADZONE:
+		return config_parse_deadzone(buf, &settings->stick_deadzone);
+	case XPADNEO_CONFIG_STICK_ANTI_DEADZONE:
+		return config_parse_deadzone(buf, &settings->stick_anti_deadzone);
+	case XPADNEO_CONFIG_STICK_CURVE:
+		return config_parse_curve(buf, settings->stick_curve);
+	case XPADNEO_CONFIG_AXIS_FILTER:
+		return kstrtobool(buf, &settings->axis_filter);
+	case XPADNEO_CONFIG_AXIS_FILTER_MIN_CUTOFF:
+		return kstrtou32(buf, 10, &settings->axis_filter_min_cutoff);
+	case XPADNEO_CONFIG_AXIS_FILTER_BETA:
+		return kstrtou32(buf, 10, &settings->axis_filter_beta);
+	case XPADNEO_CONFIG_BUTTON_MAP:
+		return config_parse_button_map(buf, settings->button_map);
+	case XPADNEO_CONFIG_TURBO_MAP:
+		return config_parse_turbo_map(buf, settings->turbo_map);
+	default:
+		return -EINVAL;
+	}
+}
+
+static ssize_t config_store(struct device *dev, const char *buf, size_t count,
+			    enum xpadneo_config_field field)
+{
+	struct xpadneo_devdata *xdata = to_xpadneo_devdata(dev);
+	const struct xpadneo_config *old;
+	struct xpadneo_settings settings;
+	unsigned long overrides;
+	int ret;
+
+	guard(mutex)(&config_lock);
+	old = rcu_dereference_protected(xdata->config, lockdep_is_held(&config_lock));
+	settings = old->settings;
+	overrides = old->overrides;
+
+	/* "default" follows the module parameter again */
+	if (sysfs_streq(buf, "default")) {
+		config_copy_field(&settings, &param_settings, field);
+		__clear_bit(field, &overrides);
+	} else {
+		ret = config_parse_field(&settings, buf, field);
+		if (ret)
+			return ret;
+		__set_bit(field, &overrides);
+	}
+
+	ret = config_publish(xdata, &settings, overrides);
+	return ret ? ret : count;
+}
+
+#define XPADNEO_CONFIG_ATTR(_name, _field)						\
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf)	\
+{											\
+	return config_show(dev, buf, _field);						\
+}											\
+static ssize_t _name##_store(struct device *dev, struct device_attribute *attr,		\
+			     const char *buf, size_t count)				\
+{											\
+	return config_store(dev, buf, count, _field);					\
+}											\
+static DEVICE_ATTR_RW(_name)
+
+XPADNEO_CONFIG_ATTR(rumble_attenuation, XPADNEO_CONFIG_RUMBLE_ATTENUATION);
+XPADNEO_CONFIG_ATTR(trigger_rumble_mode, XPADNEO_CONFIG_TRIGGER_RUMBLE_MODE);
+XPADNEO_CONFIG_ATTR(rumble_deadband, XPADNEO_CONFIG_RUMBLE_DEADBAND);
+XPADNEO_CONFIG_ATTR(rumble_report_rate, XPADNEO_CONFIG_RUMBLE_REPORT_RATE);
+XPADNEO_CONFIG_ATTR(disable_deadzones, XPADNEO_CONFIG_DISABLE_DEADZONES);
+XPADNEO_CONFIG_ATTR(disable_shift_mode, XPADNEO_CONFIG_DISABLE_SHIFT_MODE);
+XPADNEO_CONFIG_ATTR(shift_window, XPADNEO_CONFIG_SHIFT_WINDOW);
+XPADNEO_CONFIG_ATTR(trigger_mode, XPADNEO_CONFIG_TRIGGER_MODE);
+XPADNEO_CONFIG_ATTR(mouse_report_rate, XPADNEO_CONFIG_MOUSE_REPORT_RATE);
+XPADNEO_CONFIG_ATTR(mouse_deadzone, XPADNEO_CONFIG_MOUSE_DEADZONE);
+XPADNEO_CONFIG_ATTR(mouse_curve, XPADNEO_CONFIG_MOUSE_CURVE);
+XPADNEO_CONFIG_ATTR(stick_mode, XPADNEO_CONFIG_STICK_MODE);
+XPADNEO_CONFIG_ATTR(stick_deadzone, XPADNEO_CONFIG_STICK_DEADZONE);
+XPADNEO_CONFIG_ATTR(stick_anti_deadzone, XPADNEO_CONFIG_STICK_ANTI_DEADZONE);
+XPADNEO_CONFIG_ATTR(stick_curve, XPADNEO_CONFIG_STICK_CURVE);
+XPADNEO_CONFIG_ATTR(axis_filter, XPADNEO_CONFIG_AXIS_FILTER);
+XPADNEO_CONFIG_ATTR(axis_filter_min_cutoff, XPADNEO_CONFIG_AXIS_FILTER_MIN_CUTOFF);
+XPADNEO_CONFIG_ATTR(axis_filter_beta, XPADNEO_CONFIG_AXIS_FILTER_BETA);
+XPADNEO_CONFIG_ATTR(button_map, XPADNEO_CONFIG_BUTTON_MAP);
+XPADNEO_CONFIG_ATTR(turbo_map, XPADNEO_CONFIG_TURBO_MAP);
+
+static struct attribute *config_attrs[] = {
+	&dev_attr_rumble_attenuation.attr,
+	&dev_attr_trigger_rumble_mode.attr,
+	&dev_attr_rumble_deadband.attr,
+	&dev_attr_rumble_report_rate.attr,
+	&dev_attr_disable_deadzones.attr,
+	&dev_attr_disable_shift_mode.attr,
+	&dev_attr_shift_window.attr,
+	&dev_attr_trigger_mode.attr,
+	&dev_attr_mouse_report_rate.attr,
+	&dev_attr_mouse_deadzone.attr,
+	&dev_attr_mouse_curve.attr,
+	&dev_attr_stick_mode.attr,
+	&dev_attr_stick_deadzone.attr,
+	&dev_attr_stick_anti_deadzone.attr,
+	&dev_attr_stick_curve.attr,
+	&dev_attr_axis_filter.attr,
+	&dev_attr_axis_filter_min_cutoff.attr,
+	&dev_attr_axis_filter_beta.attr,
+	&dev_attr_button_map.attr,
+	&dev_attr_turbo_map.attr,
+	NULL
+};
+
+const struct attribute_group xpadneo_config_attr_group = {
+	.attrs = config_attrs,
+};
+
+int xpadneo_config_init(struct xpadneo_devdata *xdata)
+{
+	int ret;
+
+	/* parameter writes refresh the list after us, so a torn read is corrected */
+	guard(mutex)(&config_lock);
+	ret = config_publish(xdata, &param_settings, 0);
+	if (!ret)
+		list_add_tail(&xdata->config_node, &config_devices);
+
+	return ret;
+}
+
+/* apply per-device overrides saved from a previous connection */
+int xpadneo_config_restore(struct xpadneo_devdata *xdata, const struct xpadneo_settings *saved,
+			   unsigned long overrides)
+{
+	struct xpadneo_settings settings;
+	unsigned long field;
+
+	/* parameter writes refresh the list after us, so a torn read is corrected */
+	guard(mutex)(&config_lock);
+	settings = param_settings;
+	for_each_set_bit(field, &overrides, XPADNEO_CONFIG_FIELD_NUM)
+		config_copy_field(&settings, saved, field);
+
+	return config_publish(xdata, &settings, overrides);
+}
+
+void xpadneo_config_remove(struct xpadneo_devdata *xdata)
+{
+	struct xpadneo_config *config;
+
+	scoped_guard(mutex, &config_lock) {
+		list_del(&xdata->config_node);
+		config = rcu_dereference_protected(xdata->config, lockdep_is_held(&config_lock));
+		RCU_INIT_POINTER(xdata->config, NULL);
+	}
+
+	kfree_rcu(config, rcu);
+}
@@ -13,7 +13,8 @@ int xpadneo_consumer_init(struct xpadneo_devdata *xdata)
 	int ret;
 
 	if (!xdata->consumer.idev) {
-		ret = xpadneo_synthetic_init(xdata, "Consumer Control", &xdata->consumer);
+		ret = xpadneo_synthetic_init(xdata, "Consumer Control", &xdata->consumer,
+					     XPADNEO_SYNTHETIC_CONSUMER);
 		if (ret || !xdata->consumer.idev)
 			return ret;
 	}
@@ -21,10 +22,6 @@ int xpadneo_consumer_init(struct xpadneo_devdata *xdata)
 	/* enable consumer events for mouse mode */
 	input_set_capability(xdata->consumer.idev, EV_KEY, KEY_ONSCREEN_KEYBOARD);
 
-	ret = xpadneo_synthetic_register(xdata, "consumer control", &xdata->consumer);
-	if (ret)
-		return ret;
-
 	return 0;
 }
 
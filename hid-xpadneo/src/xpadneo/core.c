@@ -13,7 +13,10 @@
 #include <linux/hid.h>
 #include <linux/idr.h>
 #include <linux/input.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
+#include <linux/suspend.h>
+#include <linux/workqueue.h>
 
 #include "xpadneo.h"
 
@@ -97,10 +100,57 @@ err_free_name:
 	return ret;
 }
 
+static inline void core_probe_phase(struct xpadneo_devdata *xdata,
+				    enum xpadneo_probe_phase phase, ktime_t *since)
+{
+	ktime_t now = ktime_get();
+
+	xdata->probe.phase[phase] = ktime_sub(now, *since);
+	*since = now;
+}
+
+static void core_subdevices_worker(struct work_struct *work)
+{
+	struct xpadneo_devdata *xdata =
+	    container_of(work, struct xpadneo_devdata, subdevices_worker);
+	unsigned long *requested = &xdata->subdevices_requested;
+	ktime_t start = ktime_get();
+
+	/*
+	 * The gamepad is already usable at this point, so a failing synthetic
+	 * device only disables the features depending on it.
+	 */
+	if (test_bit(XPADNEO_SYNTHETIC_CONSUMER, requested))
+		xpadneo_synthetic_register(xdata, "consumer control", &xdata->consumer);
+	if (test_bit(XPADNEO_SYNTHETIC_KEYBOARD, requested))
+		xpadneo_synthetic_register(xdata, "keyboard", &xdata->keyboard);
+	if (test_bit(XPADNEO_SYNTHETIC_MOUSE, requested))
+		xpadneo_synthetic_register(xdata, "mouse", &xdata->mouse);
+
+	/* replay the Share button press which requested the keyboard */
+	if (test_and_clear_bit(XPADNEO_SYNTHETIC_REPLAY_SHARE, requested)
+	    && xpadneo_subdevice_ready(&xdata->keyboard)) {
+		input_report_key(xdata->keyboard.idev, BTN_SHARE, 1);
+		input_sync(xdata->keyboard.idev);
+		if (!READ_ONCE(xdata->share_held)) {
+			input_report_key(xdata->keyboard.idev, BTN_SHARE, 0);
+			input_sync(xdata->keyboard.idev);
+		}
+	}
+
+	/* accumulate, sub devices may be requested one after another */
+	xdata->probe.phase[XPADNEO_PROBE_REGISTER] += ktime_sub(ktime_get(), start);
+}
+
+void xpadneo_core_free_id(int id)
+{
+	ida_free(&xpadneo_core_device_id_allocator, id);
+}
+
 static void core_release_device_id(struct xpadneo_devdata *xdata)
 {
 	if (xdata->id >= 0) {
-		ida_free(&xpadneo_core_device_id_allocator, xdata->id);
+		xpadneo_core_free_id(xdata->id);
 		xdata->id = -1;
 	}
 }
@@ -130,7 +180,14 @@ static void core_remove(struct hid_device *hdev)
 		hdev->product = xdata->original_product;
 	}
 
+	xpadneo_sysfs_remove(xdata);
+	xpadneo_turbo_remove_timer(xdata);
+	cancel_work_sync(&xdata->subdevices_worker);
+	xpadneo_events_remove_timer(xdata);
+	xpadneo_filter_remove_timer(xdata);
 	xpadneo_mouse_remove_timer(xdata);
+	xpadneo_cache_put_state(xdata);
+	xpadneo_standby_park(xdata);
 	xpadneo_rumble_remove(xdata);
 	xpadneo_quirks_remove(xdata);
 	xpadneo_power_remove(xdata);
@@ -140,6 +197,9 @@ static void core_remove(struct hid_device *hdev)
 
 	core_release_device_id(xdata);
 	hid_hw_stop(hdev);
+	xpadneo_device_arbitrate_remove(xdata);
+	xpadneo_state_remove(xdata);
+	xpadneo_config_remove(xdata);
 }
 
 #if KERNEL_VERSION(4, 18, 0) > LINUX_VERSION_CODE
@@ -149,12 +209,25 @@ static int core_probe(struct hid_device *hdev, const struct hid_device_id *id)
 {
 	int ret, index;
 	struct xpadneo_devdata *xdata;
+	ktime_t phase;
 
 	xdata = devm_kzalloc(&hdev->dev, sizeof(*xdata), GFP_KERNEL);
 	if (xdata == NULL)
 		return -ENOMEM;
 
-	index = ida_alloc(&xpadneo_core_device_id_allocator, GFP_KERNEL);
+	xdata->probe.start = ktime_get();
+	phase = xdata->probe.start;
+	INIT_WORK(&xdata->subdevices_worker, core_subdevices_worker);
+	xpadneo_events_init_timer(xdata);
+	xpadneo_filter_init_timer(xdata);
+	xpadneo_turbo_init_timer(xdata);
+	xpadneo_power_init_timer(xdata);
+
+	/* a quick reconnect reuses the id and devices of the previous connection */
+	xdata->hdev = hdev;
+	index = xpadneo_standby_claim(xdata);
+	if (index < 0)
+		index = ida_alloc(&xpadneo_core_device_id_allocator, GFP_KERNEL);
 	if (index < 0)
 		return index;
 	xdata->id = index;
@@ -165,7 +238,6 @@ static int core_probe(struct hid_device *hdev, const struct hid_device_id *id)
 	if (xdata->device_flags & XPADNEO_DEVFLAG_SKIP_HEURISTICS)
 		xdata->quirks |= XPADNEO_QUIRK_NO_HEURISTICS;
 
-	xdata->hdev = hdev;
 	hdev->quirks |= HID_QUIRK_INPUT_PER_APP;
 	hdev->quirks |= HID_QUIRK_NO_INPUT_SYNC;
 	hid_set_drvdata(hdev, xdata);
@@ -240,21 +312,52 @@ static int core_probe(struct hid_device *hdev, const struct hid_device_id *id)
 			 xdata->original_vendor, hdev->vendor, xdata->original_product,
 			 hdev->product);
 
+	ret = xpadneo_config_init(xdata);
+	if (ret)
+		goto err_release_id;
+
+	xpadneo_standby_restore(xdata);
+
 	ret = hid_parse(hdev);
 	if (ret) {
 		hid_err(hdev, "parse failed\n");
-		goto err_release_id;
+		goto err_remove_config;
 	}
 
+	core_probe_phase(xdata, XPADNEO_PROBE_PARSE, &phase);
+
 	ret = hid_hw_start(hdev, HID_CONNECT_DEFAULT);
 	if (ret) {
 		hid_err(hdev, "hw start failed\n");
-		goto err_release_id;
+		goto err_remove_config;
 	}
 
+	core_probe_phase(xdata, XPADNEO_PROBE_HW_START, &phase);
+
+	/*
+	 * The gamepad input device exists now, finish everything it depends on
+	 * first and defer registration of the synthetic sub devices until they
+	 * are used.
+	 */
+	ret = core_init_base_device(hdev);
+	if (ret) {
+		hid_err(hdev, "hw init failed: %d\n", ret);
+		goto err_stop_hw;
+	}
+
+	core_probe_phase(xdata, XPADNEO_PROBE_BASE, &phase);
+
+	ret = xpadneo_rumble_init(hdev);
+	if (ret)
+		hid_err(hdev, "could not initialize rumble, continuing anyway\n");
+	else
+		xpadneo_device_arbitrate(xdata);
+
+	core_probe_phase(xdata, XPADNEO_PROBE_RUMBLE, &phase);
+
 	ret = xpadneo_consumer_init(xdata);
 	if (ret)
-		goto err_stop_hw;
+		goto err_uninit_rumble;
 
 	ret = xpadneo_keyboard_init(xdata);
 	if (ret)
@@ -264,19 +367,25 @@ static int core_probe(struct hid_device *hdev, const struct hid_device_id *id)
 	if (ret)
 		goto err_uninit_keyboard;
 
-	ret = core_init_base_device(hdev);
-	if (ret) {
-		hid_err(hdev, "hw init failed: %d\n", ret);
+	ret = xpadneo_sysfs_init(xdata);
+	if (ret)
 		goto err_uninit_mouse;
-	}
 
-	ret = xpadneo_rumble_init(hdev);
+	ret = xpadneo_state_init(xdata);
 	if (ret)
-		hid_err(hdev, "could not initialize rumble, continuing anyway\n");
+		hid_err(hdev, "could not initialize state page, continuing anyway\n");
 
 	xpadneo_mouse_init_timer(xdata);
+	xpadneo_standby_finish(xdata);
+	xpadneo_cache_restore_state(xdata);
 
-	hid_info(hdev, "%s connected\n", xdata->battery.name);
+	core_probe_phase(xdata, XPADNEO_PROBE_SUBDEVICES, &phase);
+
+	xdata->probe.phase[XPADNEO_PROBE_TOTAL] = ktime_sub(phase, xdata->probe.start);
+	xpadneo_synthetic_request_eager(xdata);
+
+	hid_info(hdev, "%s connected after %lldus\n", xdata->battery.name,
+		 ktime_to_us(xdata->probe.phase[XPADNEO_PROBE_TOTAL]));
 
 	return 0;
 
@@ -290,8 +399,21 @@ err_uninit_keyboard:
 err_uninit_consumer:
 	xpadneo_consumer_remove(xdata);
 
+err_uninit_rumble:
+	xpadneo_rumble_remove(xdata);
+	xpadneo_quirks_remove(xdata);
+	xpadneo_power_remove(xdata);
+
 err_stop_hw:
+	xpadneo_events_remove_timer(xdata);
+	xpadneo_filter_remove_timer(xdata);
+	xpadneo_turbo_remove_timer(xdata);
 	hid_hw_stop(hdev);
+	xpadneo_power_remove_timer(xdata);
+	xpadneo_device_arbitrate_remove(xdata);
+
+err_remove_config:
+	xpadneo_config_remove(xdata);
 
 err_release_id:
 	/* restore the original device IDs first */
@@ -299,12 +421,91 @@ err_release_id:
 	hdev->product = xdata->original_product;
 	hdev->version = xdata->original_version;
 
+	xpadneo_standby_finish(xdata);
 	core_release_device_id(xdata);
 	return ret;
 }
 
+/*
+ * xpadneo_core_power_off - the controller announced that it powers off
+ *
+ * The link only times out seconds later, so release everything right away to
+ * let games see the player leave. This runs from the battery report and must
+ * not sleep.
+ */
+void xpadneo_core_power_off(struct xpadneo_devdata *xdata)
+{
+	if (xdata->shutdown)
+		return;
+
+	/* pairs with the lock taken by xpadneo_rumble_shutdown() */
+	WRITE_ONCE(xdata->shutdown, true);
+
+	xpadneo_rumble_shutdown(xdata);
+	xpadneo_mouse_stop(xdata);
+	xpadneo_events_release(xdata);
+}
+
+/* the controller reports again before the link timed out */
+void xpadneo_core_power_on(struct xpadneo_devdata *xdata)
+{
+	if (!xdata->shutdown)
+		return;
+
+	WRITE_ONCE(xdata->shutdown, false);
+	hid_info(xdata->hdev, "powered on again\n");
+}
+
+/*
+ * The controller usually keeps its link across a short system sleep, so we do
+ * not tear anything down: quiesce the rumble and mouse timers, stop the motors
+ * and remember the runtime state in case the link drops and the controller
+ * comes back with a full probe.
+ */
+static void core_suspend_device(struct xpadneo_devdata *xdata)
+{
+	if (xdata->suspended)
+		return;
+
+	xdata->suspended = true;
+	xpadneo_rumble_suspend(xdata);
+	xpadneo_mouse_stop(xdata);
+	xpadneo_turbo_stop(xdata);
+	xpadneo_cache_put_state(xdata);
+}
+
+static void core_resume_device(struct xpadneo_devdata *xdata)
+{
+	if (!xdata->suspended)
+		return;
+
+	/* process the first report after resume completely, even if it repeats */
+	memset(xdata->input_report_0x01, 0, sizeof(xdata->input_report_0x01));
+
+	xpadneo_rumble_resume(xdata);
+	xdata->suspended = false;
+}
+
+#ifdef CONFIG_PM
+static int core_suspend(struct hid_device *hdev, pm_message_t message)
+{
+	core_suspend_device(hid_get_drvdata(hdev));
+	return 0;
+}
+
+static int core_resume(struct hid_device *hdev)
+{
+	core_resume_device(hid_get_drvdata(hdev));
+	return 0;
+}
+#endif
+
 static struct hid_driver core_driver = {
 	.name = "xpadneo",
+	.driver = {
+		/* do not serialize multiple controllers or the boot on our probe */
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+	},
 	.event = xpadneo_events_event,
 	.id_table = core_devices,
 	.input_configured = xpadneo_events_input_configured,
@@ -314,8 +515,64 @@ static struct hid_driver core_driver = {
 	.report = xpadneo_device_report,
 	.report_fixup = xpadneo_device_report_fixup_compat,
 	.raw_event = xpadneo_events_raw_event,
+#ifdef CONFIG_PM
+	.suspend = core_suspend,
+	.resume = core_resume,
+	.reset_resume = core_resume,
+#endif
 };
 
+#ifdef CONFIG_PM_SLEEP
+/*
+ * Bluetooth transports do not forward suspend and resume to HID drivers, so
+ * we also follow the system sleep transitions. The device lock serializes us
+ * against probe, remove and the HID callbacks above.
+ */
+static int core_pm_device(struct device *dev, void *data)
+{
+	bool suspend = *(bool *)data;
+	struct xpadneo_devdata *xdata;
+
+	device_lock(dev);
+	xdata = dev->driver ? hid_get_drvdata(to_hid_device(dev)) : NULL;
+	if (xdata) {
+		if (suspend)
+			core_suspend_device(xdata);
+		else
+			core_resume_device(xdata);
+	}
+	device_unlock(dev);
+
+	return 0;
+}
+
+static int core_pm_notify(struct notifier_block *nb, unsigned long action, void *unused)
+{
+	bool suspend;
+
+	switch (action) {
+	case PM_HIBERNATION_PREPARE:
+	case PM_SUSPEND_PREPARE:
+		suspend = true;
+		break;
+	case PM_POST_HIBERNATION:
+	case PM_POST_RESTORE:
+	case PM_POST_SUSPEND:
+		suspend = false;
+		break;
+	default:
+		return NOTIFY_DONE;
+	}
+
+	driver_for_each_device(&core_driver.driver, NULL, &suspend, core_pm_device);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block core_pm_notifier = {
+	.notifier_call = core_pm_notify,
+};
+#endif
+
 static int __init core_init(void)
 {
 	int ret;
@@ -330,13 +587,23 @@ static int __init core_init(void)
 			xpadneo_rumble_destroy_workqueue();
 	}
 
+#ifdef CONFIG_PM_SLEEP
+	if (!ret)
+		register_pm_notifier(&core_pm_notifier);
+#endif
+
 	return ret;
 }
 
 static void __exit core_exit(void)
 {
 	dbg_hid("xpadneo:%s\n", __func__);
+#ifdef CONFIG_PM_SLEEP
+	unregister_pm_notifier(&core_pm_notifier);
+#endif
 	hid_unregister_driver(&core_driver);
+	xpadneo_standby_flush();
+	xpadneo_cache_flush();
 	ida_destroy(&xpadneo_core_device_id_allocator);
 	xpadneo_rumble_destroy_workqueue();
 }
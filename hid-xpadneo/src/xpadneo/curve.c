@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo fixed-point response curves
+ *
+ * Curves are compiled into a lookup table when they are configured, so the
+ * event path only needs a single table lookup per axis.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/ctype.h>
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "xpadneo.h"
+
+/* fixed-point 1.0 in Q15, matching full stick deflection */
+#define CURVE_ONE XPADNEO_CURVE_MAX
+
+/* limits of user supplied curves */
+#define CURVE_POINTS_MAX   16
+#define CURVE_EXPONENT_MIN 250	/* 0.25 in per mille */
+#define CURVE_EXPONENT_MAX 4000	/* 4.00 in per mille */
+#define CURVE_OUTPUT_MAX   200	/* percent of full scale */
+
+struct curve_point {
+	u32 x, y;
+};
+
+/*
+ * x^e for x in Q15 and e in 1/256 steps: the integer part is multiplied,
+ * each fractional bit multiplies another repeated square root of x
+ */
+static u32 curve_pow(u32 x, u32 e)
+{
+	u32 y = CURVE_ONE, r = x;
+
+	for (u32 i = 0; i < (e >> 8); i++)
+		y = (y * x) >> 15;
+
+	for (int i = 7; i >= 0; i--) {
+		r = int_sqrt(r << 15);
+		if (e & BIT(i))
+			y = (y * r) >> 15;
+	}
+
+	return y;
+}
+
+static u32 curve_interpolate(const struct curve_point *points, int num, u32 x)
+{
+	const struct curve_point *p0, *p1;
+	int i;
+
+	for (i = 1; (i < num) && (points[i].x < x); i++)
+		;
+
+	/* hold the last value beyond the last point */
+	if (i == num)
+		return points[num - 1].y;
+
+	p0 = &points[i - 1];
+	p1 = &points[i];
+	return p0->y + div_s64((s64)((s32)p1->y - (s32)p0->y) * (x - p0->x), p1->x - p0->x);
+}
+
+/* parse a decimal number like "1.25" into per mille */
+static int curve_parse_permille(const char *s, u32 *permille)
+{
+	u32 value = 0, digits = 0;
+	bool fraction = false;
+
+	if (!*s)
+		return -EINVAL;
+
+	for (; *s; s++) {
+		if ((*s == '.') && !fraction) {
+			fraction = true;
+			continue;
+		}
+
+		if (!isdigit(*s) || (value > 100000))
+			return -EINVAL;
+
+		/* ignore excess precision */
+		if (fraction && (digits == 3))
+			continue;
+
+		value = value * 10 + (*s - '0');
+		if (fraction)
+			digits++;
+	}
+
+	for (; digits < 3; digits++)
+		value *= 10;
+
+	*permille = value;
+	return 0;
+}
+
+/* parse "x:y" in percent of full scale */
+static int curve_parse_point(char *s, struct curve_point *point)
+{
+	char *y = strchr(s, ':');
+
+	if (!y)
+		return -EINVAL;
+	*y++ = '\0';
+
+	if (kstrtou32(s, 10, &point->x) || kstrtou32(y, 10, &point->y))
+		return -EINVAL;
+
+	if ((point->x > 100) || (point->y > CURVE_OUTPUT_MAX))
+		return -EINVAL;
+
+	point->x = point->x * CURVE_ONE / 100;
+	point->y = point->y * CURVE_ONE / 100;
+	return 0;
+}
+
+/*
+ * xpadneo_curve_create - compile a response curve into a lookup table
+ * @spec:     "linear", "power <exponent>", or "points <x:y> [<x:y> ...]"
+ *            with x and y in percent of full scale
+ * @deadzone: raw axis values below this map to zero, the remaining range
+ *            is stretched to full scale before applying the curve
+ *
+ * Returns the new curve, or an ERR_PTR() if the spec is invalid.
+ */
+struct xpadneo_curve *xpadneo_curve_create(const char *spec, u16 deadzone)
+{
+	struct curve_point points[CURVE_POINTS_MAX + 1] = { };
+	struct xpadneo_curve *curve;
+	char *buf, *args, *type, *arg;
+	u32 exponent = 256;
+	int num = 0, ret = 0;
+
+	if (deadzone >= XPADNEO_CURVE_MAX)
+		return ERR_PTR(-EINVAL);
+
+	curve = kzalloc(sizeof(*curve), GFP_KERNEL);
+	buf = kstrndup(spec, XPADNEO_CURVE_SPEC_LEN, GFP_KERNEL);
+	if (!curve || !buf) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	args = strim(buf);
+	if (strscpy(curve->spec, args, sizeof(curve->spec)) < 0) {
+		ret = -EINVAL;
+		goto err_free;
+	}
+
+	type = strsep(&args, " \t");
+	if (strcmp(type, "linear") == 0) {
+		if (args && *skip_spaces(args))
+			ret = -EINVAL;
+	} else if (strcmp(type, "power") == 0) {
+		u32 permille;
+
+		arg = args ? skip_spaces(args) : "";
+		ret = curve_parse_permille(arg, &permille);
+		if (!ret && ((permille < CURVE_EXPONENT_MIN) || (permille > CURVE_EXPONENT_MAX)))
+			ret = -EINVAL;
+		exponent = DIV_ROUND_CLOSEST(permille * 256, 1000);
+	} else if (strcmp(type, "points") == 0) {
+		/* the curve always starts in the origin */
+		num = 1;
+		while (!ret && args && (arg = strsep(&args, " \t"))) {
+			if (!*arg)
+				continue;
+			if (num > CURVE_POINTS_MAX) {
+				ret = -EINVAL;
+				break;
+			}
+			ret = curve_parse_point(arg, &points[num]);
+			if (!ret && (points[num].x <= points[num - 1].x)) {
+				/* an explicit origin replaces the implicit one */
+				if ((num == 1) && (points[1].x == 0)) {
+					points[0] = points[1];
+					continue;
+				}
+				ret = -EINVAL;
+			}
+			num++;
+		}
+		if (num < 2)
+			ret = -EINVAL;
+	} else {
+		ret = -EINVAL;
+	}
+
+	if (ret)
+		goto err_free;
+
+	for (int i = 0; i <= XPADNEO_CURVE_SIZE; i++) {
+		u32 x = min_t(u32, i << XPADNEO_CURVE_SHIFT, XPADNEO_CURVE_MAX), y;
+
+		if (x < deadzone) {
+			curve->lut[i] = 0;
+			continue;
+		}
+
+		/* stretch the range outside of the dead zone to full scale */
+		x = (x - deadzone) * CURVE_ONE / (CURVE_ONE - deadzone);
+		y = num ? curve_interpolate(points, num, x) : curve_pow(x, exponent);
+		curve->lut[i] = min_t(u32, y, U16_MAX);
+	}
+
+	kfree(buf);
+	return curve;
+
+err_free:
+	kfree(buf);
+	kfree(curve);
+	return ERR_PTR(ret);
+}
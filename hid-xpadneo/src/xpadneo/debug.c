@@ -127,13 +127,13 @@ void xpadneo_debug_hid_report(const struct hid_device *hdev, const void *buf, co
  *
  * Unconditionally emits one line containing the descriptor byte-length and
  * CRC-16 checksum (CRC-16/IBM, poly 0x8005, init 0), plus one line
- * describing the OUI flags.
+ * describing the OUI flags. Returns the checksum.
  *
  * Additionally performs a full hex-dump when:
  *   - the module parameter debug_descriptor=1 is set, OR
  *   - the device's Bluetooth OUI is locally administered (LAA).
  */
-void xpadneo_debug_descriptor(const struct hid_device *hdev, const __u8 *rdesc, unsigned int rsize)
+u16 xpadneo_debug_descriptor(const struct hid_device *hdev, const __u8 *rdesc, unsigned int rsize)
 {
 	u8 oui0 = 0, oui1 = 0, oui2 = 0;
 	u16 crc = crc16(0, rdesc, rsize);
@@ -175,4 +175,6 @@ void xpadneo_debug_descriptor(const struct hid_device *hdev, const __u8 *rdesc,
 		print_hex_dump(KERN_INFO, "xpadneo hid-desc: ", DUMP_PREFIX_OFFSET, 32, 1, rdesc,
 			       rsize, false);
 	}
+
+	return crc;
 }
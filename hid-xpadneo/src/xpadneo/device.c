@@ -8,15 +8,36 @@
 
 #include <linux/delay.h>
 #include <linux/module.h>
+#include <linux/sched.h>
 
 #include "xpadneo.h"
 
+/* always include last */
+#include "compat.h"
+
+static bool param_report_fixups = 1;
+module_param_named(report_fixups, param_report_fixups, bool, 0644);
+MODULE_PARM_DESC(report_fixups,
+		 "(bool) Apply the built-in descriptor and button layout fixups. "
+		 "0: leave them to a HID-BPF program, 1: enable.");
+
+static bool param_arbitrate_hidraw = 1;
+module_param_named(arbitrate_hidraw, param_arbitrate_hidraw, bool, 0644);
+MODULE_PARM_DESC(arbitrate_hidraw,
+		 "(bool) Merge rumble reports written through hidraw with the driver's rumble. "
+		 "0: pass them to the controller unchanged, 1: enable.");
+
 int xpadneo_device_output_report(struct hid_device *hdev, __u8 *buf, size_t len, bool uses_hogp)
 {
+	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
 	struct xpadneo_rumble_report *r = (struct xpadneo_rumble_report *)buf;
+	int ret;
 
 	xpadneo_debug_hid_report(hdev, buf, len);
 
+	/* our own reports pass the output arbitration, only one task sends them at a time */
+	WRITE_ONCE(xdata->output_owner, current);
+
 	/*
 	 * Some BLE controllers (e.g. XBE2 0x0B22) require a GATT Write Request
 	 * (acknowledged) rather than the unacknowledged GATT Write Command that
@@ -27,14 +48,94 @@ int xpadneo_device_output_report(struct hid_device *hdev, __u8 *buf, size_t len,
 	 * give the device time to process the report before the next one is sent.
 	 */
 	if (uses_hogp) {
-		return hid_hw_raw_request(hdev, r->report_id, buf, len,
-					  HID_OUTPUT_REPORT, HID_REQ_SET_REPORT);
+		ret = hid_hw_raw_request(hdev, r->report_id, buf, len,
+					 HID_OUTPUT_REPORT, HID_REQ_SET_REPORT);
+		WRITE_ONCE(xdata->output_owner, NULL);
 	} else {
-		int ret = hid_hw_output_report(hdev, buf, len);
+		ret = hid_hw_output_report(hdev, buf, len);
+		WRITE_ONCE(xdata->output_owner, NULL);
 
 		msleep(20);
-		return ret;
 	}
+
+	return ret;
+}
+
+/*
+ * Rumble reports written by other clients (i.e. Steam through hidraw) go
+ * through the transport driver. Take them over into the rumble slot, so the
+ * rumble worker coalesces and paces them together with our own effects.
+ */
+static bool device_arbitrate_output(struct hid_device *hdev, const __u8 *buf, size_t len,
+				    int *ret)
+{
+	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
+	const struct xpadneo_rumble_report *r = (const struct xpadneo_rumble_report *)buf;
+
+	if (!READ_ONCE(param_arbitrate_hidraw) || (READ_ONCE(xdata->output_owner) == current))
+		return false;
+
+	if ((len != sizeof(*r)) || (r->report_id != XPADNEO_XBOX_RUMBLE_REPORT))
+		return false;
+
+	*ret = xpadneo_rumble_merge(xdata, &r->data);
+	if (!*ret)
+		*ret = len;
+
+	return true;
+}
+
+static int device_ll_output_report(struct hid_device *hdev, __u8 *buf, size_t len)
+{
+	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
+	int ret;
+
+	if (device_arbitrate_output(hdev, buf, len, &ret))
+		return ret;
+
+	return xdata->ll_driver->output_report(hdev, buf, len);
+}
+
+static int device_ll_raw_request(struct hid_device *hdev, unsigned char reportnum, __u8 *buf,
+				 size_t len, unsigned char rtype, int reqtype)
+{
+	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
+	int ret;
+
+	if ((rtype == HID_OUTPUT_REPORT) && (reqtype == HID_REQ_SET_REPORT)
+	    && device_arbitrate_output(hdev, buf, len, &ret))
+		return ret;
+
+	return xdata->ll_driver->raw_request(hdev, reportnum, buf, len, rtype, reqtype);
+}
+
+/*
+ * xpadneo_device_arbitrate - route rumble reports of other clients through us
+ *
+ * Wraps the transport driver of the device, must only be called once rumble
+ * is initialized. Other requests pass through unchanged.
+ */
+void xpadneo_device_arbitrate(struct xpadneo_devdata *xdata)
+{
+	struct hid_device *hdev = xdata->hdev;
+
+	xdata->ll_driver = hdev->ll_driver;
+	xdata->ll_arbiter = *hdev->ll_driver;
+	xdata->ll_arbiter.raw_request = device_ll_raw_request;
+	if (xdata->ll_driver->output_report)
+		xdata->ll_arbiter.output_report = device_ll_output_report;
+
+	hdev->ll_driver = &xdata->ll_arbiter;
+}
+
+/* restore the transport driver, hidraw must be disconnected already */
+void xpadneo_device_arbitrate_remove(struct xpadneo_devdata *xdata)
+{
+	if (!xdata->ll_driver)
+		return;
+
+	xdata->hdev->ll_driver = xpadneo_ll_driver_ptr(xdata->ll_driver);
+	xdata->ll_driver = NULL;
 }
 
 void xpadneo_device_missing(struct xpadneo_devdata *xdata, u32 flag)
@@ -62,15 +163,18 @@ void xpadneo_device_missing(struct xpadneo_devdata *xdata, u32 flag)
 
 static inline void sync_device(struct xpadneo_subdevice *subdev)
 {
-	if (subdev->idev && subdev->sync) {
+	if (subdev->sync && xpadneo_subdevice_ready(subdev)) {
 		subdev->sync = false;
 		input_sync(subdev->idev);
 	}
 }
 
-void xpadneo_device_report(struct hid_device *hdev, struct hid_report *report)
+/* called with the lock of the axis filter held */
+void xpadneo_device_report_locked(struct xpadneo_devdata *xdata)
 {
-	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
+	/* report the processed thumb sticks with the complete report */
+	xpadneo_events_report(xdata);
+	xpadneo_state_report(xdata);
 
 	sync_device(&xdata->consumer);
 	sync_device(&xdata->gamepad);
@@ -78,6 +182,16 @@ void xpadneo_device_report(struct hid_device *hdev, struct hid_report *report)
 	sync_device(&xdata->mouse);
 }
 
+void xpadneo_device_report(struct hid_device *hdev, struct hid_report *report)
+{
+	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
+	unsigned long flags;
+
+	spin_lock_irqsave(&xdata->axis_filter.lock, flags);
+	xpadneo_device_report_locked(xdata);
+	spin_unlock_irqrestore(&xdata->axis_filter.lock, flags);
+}
+
 const __u8 *xpadneo_device_report_fixup(struct hid_device *hdev, __u8 *rdesc, unsigned int *rsize)
 {
 	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
@@ -86,7 +200,17 @@ const __u8 *xpadneo_device_report_fixup(struct hid_device *hdev, __u8 *rdesc, un
 	xdata->original_rsize = *rsize;
 
 	/* log size/CRC and optionally hex-dump before any in-place patches */
-	xpadneo_debug_descriptor(hdev, rdesc, *rsize);
+	xdata->original_crc16 = xpadneo_debug_descriptor(hdev, rdesc, *rsize);
+
+	/*
+	 * HID-BPF descriptor fixups already ran, and our fixups only apply to
+	 * the unmodified byte patterns. This also disables the button layout
+	 * fixup of the raw reports, which depends on the descriptor fixup.
+	 */
+	if (!READ_ONCE(param_report_fixups)) {
+		hid_notice(hdev, "leaving descriptor fixups to HID-BPF\n");
+		return rdesc;
+	}
 
 	/* fixup trailing NUL byte */
 	if (*rsize >= 2 && rdesc[*rsize - 2] == 0xC0 && rdesc[*rsize - 1] == 0x00) {
@@ -15,8 +15,8 @@
 /* always include last */
 #include "compat.h"
 
-/* XBE2 controllers support four profiles */
-#define XPADNEO_XBE2_PROFILES_MAX 4
+/* thumb stick dead zone reported as flat value (raw) */
+#define XPADNEO_GAMEPAD_DEADZONE 3072
 
 static bool param_gamepad_compliance = 1;
 module_param_named(gamepad_compliance, param_gamepad_compliance, bool, 0444);
@@ -24,17 +24,147 @@ MODULE_PARM_DESC(gamepad_compliance,
 		 "(bool) Adhere to Linux Gamepad Specification by using signed axis values. "
 		 "1: enable, 0: disable.");
 
-static bool param_disable_deadzones;
-module_param_named(disable_deadzones, param_disable_deadzones, bool, 0444);
-MODULE_PARM_DESC(disable_deadzones,
-		 "(bool) Disable dead zone handling for raw processing by Wine/Proton, confuses joydev. "
-		 "0: disable, 1: enable.");
+static inline bool events_shift_mode_disabled(struct xpadneo_devdata *xdata)
+{
+	bool disabled;
+
+	rcu_read_lock();
+	disabled = rcu_dereference(xdata->config)->settings.disable_shift_mode;
+	rcu_read_unlock();
+
+	return disabled;
+}
+
+static inline ktime_t events_shift_window(struct xpadneo_devdata *xdata)
+{
+	ktime_t window;
+
+	rcu_read_lock();
+	window = rcu_dereference(xdata->config)->shift_window;
+	rcu_read_unlock();
+
+	return window;
+}
+
+/* no chord followed the Xbox button in time, report the press now */
+static enum hrtimer_restart events_shift_timeout(struct hrtimer *t)
+{
+	struct xpadneo_devdata *xdata = container_of(t, struct xpadneo_devdata, shift_timer);
+
+	/* a chord or the release won the race */
+	if (cmpxchg(&xdata->shift_state, XPADNEO_SHIFT_WAIT, XPADNEO_SHIFT_EMITTED)
+	    != XPADNEO_SHIFT_WAIT)
+		return HRTIMER_NORESTART;
+
+	input_report_key(xdata->gamepad.idev, BTN_XBOX, 1);
+	input_sync(xdata->gamepad.idev);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Decide if a button pressed while holding the Xbox button is used as a chord.
+ * Once the press of the Xbox button was reported, buttons pass through as is.
+ */
+static bool events_shift_chord(struct xpadneo_devdata *xdata, s32 value)
+{
+	if (value == 0)
+		return READ_ONCE(xdata->shift_state) != XPADNEO_SHIFT_EMITTED;
+
+	switch (cmpxchg(&xdata->shift_state, XPADNEO_SHIFT_WAIT, XPADNEO_SHIFT_CHORD)) {
+	case XPADNEO_SHIFT_WAIT:
+		hrtimer_try_to_cancel(&xdata->shift_timer);
+		return true;
+	case XPADNEO_SHIFT_EMITTED:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static inline bool events_stick_event(struct xpadneo_devdata *xdata, unsigned int code,
+				      s32 value)
+{
+	bool enabled;
+
+	rcu_read_lock();
+	enabled = rcu_dereference(xdata->config)->settings.stick_mode != PARAM_STICK_MODE_OFF;
+	rcu_read_unlock();
+
+	if (!enabled)
+		return false;
+
+	switch (code) {
+	case ABS_X:
+		xdata->sticks.x[0] = value;
+		break;
+	case ABS_Y:
+		xdata->sticks.y[0] = value;
+		break;
+	case ABS_RX:
+		xdata->sticks.x[1] = value;
+		break;
+	case ABS_RY:
+		xdata->sticks.y[1] = value;
+		break;
+	}
+
+	xdata->sticks.pending = true;
+	return true;
+}
+
+static inline u32 events_stick_lookup(const struct xpadneo_config *config, u32 magnitude)
+{
+	const u16 *lut = config->stick_lut;
+	u32 index, frac;
+
+	/* interpolate between the table entries */
+	magnitude = min_t(u32, magnitude, XPADNEO_CURVE_MAX - 1);
+	index = magnitude >> XPADNEO_CURVE_SHIFT;
+	frac = magnitude & (BIT(XPADNEO_CURVE_SHIFT) - 1);
+
+	return lut[index] + ((((s32)lut[index + 1] - lut[index]) * (s32)frac) >> XPADNEO_CURVE_SHIFT);
+}
+
+static void events_stick_report(struct xpadneo_devdata *xdata,
+				const struct xpadneo_config *config, int stick,
+				unsigned int code_x, unsigned int code_y)
+{
+	struct input_dev *gamepad = xdata->gamepad.idev;
+	s32 x = xdata->sticks.x[stick], y = xdata->sticks.y[stick];
+	s32 offset = param_gamepad_compliance ? 0 : 32768;
+	u32 magnitude, scaled;
+
+	/* scale the vector by the radial response, keeping its direction */
+	magnitude = int_sqrt((u32)(x * x) + (u32)(y * y));
+	if (magnitude && (config->settings.stick_mode != PARAM_STICK_MODE_OFF)) {
+		scaled = events_stick_lookup(config, magnitude);
+		x = clamp_t(s32, x * (s32)scaled / (s32)magnitude, -32768, 32767);
+		y = clamp_t(s32, y * (s32)scaled / (s32)magnitude, -32768, 32767);
+	}
+
+	input_report_abs(gamepad, code_x, x + offset);
+	input_report_abs(gamepad, code_y, y + offset);
+	xpadneo_state_sticks(xdata, stick, x, y);
+}
+
+void xpadneo_events_report(struct xpadneo_devdata *xdata)
+{
+	const struct xpadneo_config *config;
+
+	if (!xdata->sticks.pending || !xdata->gamepad.idev)
+		return;
 
-static bool param_disable_shift_mode;
-module_param_named(disable_shift_mode, param_disable_shift_mode, bool, 0644);
-MODULE_PARM_DESC(disable_shift_mode,
-		 "(bool) Disable use Xbox logo button as shift. Will prohibit profile switching when enabled. "
-		 "0: disable, 1: enable.");
+	xdata->sticks.pending = false;
+
+	rcu_read_lock();
+	config = rcu_dereference(xdata->config);
+	events_stick_report(xdata, config, 0, ABS_X, ABS_Y);
+	events_stick_report(xdata, config, 1, ABS_RX, ABS_RY);
+	rcu_read_unlock();
+
+	xdata->gamepad.sync = true;
+}
 
 static void switch_profile(struct xpadneo_devdata *xdata, const u8 profile, const bool emulated)
 {
@@ -48,6 +178,20 @@ static void switch_profile(struct xpadneo_devdata *xdata, const u8 profile, cons
 		xdata->profile_switched = true;
 }
 
+static inline u8 events_profile_chord(unsigned int code)
+{
+	switch (code) {
+	case BTN_B:
+		return 1;
+	case BTN_X:
+		return 2;
+	case BTN_Y:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
 static void switch_triggers(struct xpadneo_devdata *xdata, const u8 mode)
 {
 	char *name[XBOX_TRIGGER_SCALE_NUM] = {
@@ -70,6 +214,66 @@ static void switch_triggers(struct xpadneo_devdata *xdata, const u8 mode)
 	}
 }
 
+/* digital trigger thresholds with hysteresis, raw values of 0..1023 */
+#define XPADNEO_TRIGGER_DIGITAL_PRESS   96
+#define XPADNEO_TRIGGER_DIGITAL_RELEASE 64
+
+/* software trigger mode of an axis, full range for anything else than a trigger */
+static enum xpadneo_trigger_scale events_trigger_mode(struct xpadneo_devdata *xdata,
+						      unsigned int code)
+{
+	enum xpadneo_trigger_scale mode;
+	int index;
+
+	switch (code) {
+	case ABS_Z:
+		index = 0;
+		break;
+	case ABS_RZ:
+		index = 1;
+		break;
+	default:
+		return XBOX_TRIGGER_SCALE_FULL;
+	}
+
+	rcu_read_lock();
+	mode = rcu_dereference(xdata->config)->settings.trigger_mode[index];
+	rcu_read_unlock();
+
+	return mode;
+}
+
+/* returns false if the digital state of the trigger did not change */
+static bool events_trigger_digital(struct xpadneo_devdata *xdata, unsigned int code, s32 *value)
+{
+	bool *pressed = &xdata->trigger_pressed[code == ABS_RZ];
+
+	if (*pressed ? (*value >= XPADNEO_TRIGGER_DIGITAL_RELEASE)
+	    : (*value <= XPADNEO_TRIGGER_DIGITAL_PRESS))
+		return false;
+
+	*pressed = !*pressed;
+	*value = *pressed ? 1023 : 0;
+	return true;
+}
+
+static inline void events_remap_buttons(struct xpadneo_devdata *xdata, u8 *data)
+{
+	const struct xpadneo_remap *remap;
+	const u16 (*lut)[256];
+	u16 bits;
+
+	rcu_read_lock();
+	remap = &rcu_dereference(xdata->config)->button_remap;
+	if (unlikely(remap->active & BIT(xdata->profile))) {
+		lut = remap->lut[xdata->profile];
+		bits = lut[0][data[14]] | lut[1][data[15]];
+		data[14] = (u8)((bits >> 0) & 0xFF);
+		data[15] = (u8)((bits >> 8) & 0xFF);
+	}
+	rcu_read_unlock();
+}
+
 int xpadneo_events_raw_event(struct hid_device *hdev, struct hid_report *report,
 			     u8 *data, int reportsize)
 {
@@ -84,6 +288,8 @@ int xpadneo_events_raw_event(struct hid_device *hdev, struct hid_report *report,
 		memcpy(&xdata->input_report_0x01, data, size);
 	}
 
+	xdata->report_time = ktime_get();
+
 	xpadneo_debug_hid_report(hdev, data, reportsize);
 
 	/* we are taking care of the battery report ourselves */
@@ -143,18 +349,66 @@ int xpadneo_events_raw_event(struct hid_device *hdev, struct hid_report *report,
 		}
 	}
 
+	/* apply the button map of the current profile */
+	if (report->id == 1 && reportsize >= 16)
+		events_remap_buttons(xdata, data);
+
 	if (xpadneo_mouse_raw_event(xdata, report, data, reportsize))
 		return -1;
 
 	return 0;
 }
 
-int xpadneo_events_event(struct hid_device *hdev, struct hid_field *field,
-			 struct hid_usage *usage, __s32 value)
+/* called with the lock of the axis filter held */
+int xpadneo_events_event_locked(struct hid_device *hdev, struct hid_field *field,
+				struct hid_usage *usage, __s32 value)
 {
 	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
 	struct input_dev *gamepad = xdata->gamepad.idev;
 	struct input_dev *keyboard = xdata->keyboard.idev;
+	bool filtered = false;
+
+	if (usage->type == EV_ABS) {
+		enum xpadneo_trigger_scale mode = events_trigger_mode(xdata, usage->code);
+
+		/* trigger rumble follows the pressure, not the processed value */
+		if (usage->code == ABS_Z)
+			xdata->last_abs_z = value;
+		else if (usage->code == ABS_RZ)
+			xdata->last_abs_rz = value;
+
+		/* mouse clicks apply their own hysteresis to the raw pressure */
+		if (((usage->code == ABS_Z) || (usage->code == ABS_RZ))
+		    && xpadneo_mouse_event(xdata, usage, value)) {
+			xpadneo_state_event(xdata, usage, value);
+			goto stop_processing;
+		}
+
+		/* digital triggers only report crossing a threshold, smoothing would delay that */
+		if (mode == XBOX_TRIGGER_SCALE_DIGITAL) {
+			if (!events_trigger_digital(xdata, usage->code, &value))
+				goto stop_processing;
+			filtered = true;
+		} else {
+			switch (xpadneo_filter_axis(xdata, field, usage, &value)) {
+			case XPADNEO_FILTER_SUPPRESS:
+				goto stop_processing;
+			case XPADNEO_FILTER_PASS:
+				filtered = true;
+				break;
+			default:
+				break;
+			}
+
+			/* full output at half of the travel */
+			if (mode == XBOX_TRIGGER_SCALE_HALF) {
+				value = min(value * 2, 1023);
+				filtered = true;
+			}
+		}
+	}
+
+	xpadneo_state_event(xdata, usage, value);
 
 	if (xpadneo_mouse_event(xdata, usage, value))
 		goto stop_processing;
@@ -175,6 +429,10 @@ int xpadneo_events_event(struct hid_device *hdev, struct hid_field *field,
 		case ABS_Y:
 		case ABS_RX:
 		case ABS_RY:
+			/* processed and reported with the complete report */
+			if (events_stick_event(xdata, usage->code, value - 32768))
+				goto stop_processing;
+
 			/* Linux Gamepad Specification */
 			if (param_gamepad_compliance) {
 				input_report_abs(gamepad, usage->code, value - 32768);
@@ -182,28 +440,49 @@ int xpadneo_events_event(struct hid_device *hdev, struct hid_field *field,
 				goto stop_processing;
 			}
 			break;
-		case ABS_Z:
-			xdata->last_abs_z = value;
-			break;
-		case ABS_RZ:
-			xdata->last_abs_rz = value;
-			break;
 		}
-	} else if (!param_disable_shift_mode && (usage->type == EV_KEY)
+
+		/* hid-input would report the unprocessed value */
+		if (filtered) {
+			input_report_abs(gamepad, usage->code, value);
+			xdata->gamepad.sync = true;
+			goto stop_processing;
+		}
+	} else if (!events_shift_mode_disabled(xdata) && (usage->type == EV_KEY)
 		   && (usage->code == BTN_XBOX)) {
 		/*
 		 * Handle the Xbox logo button: We want to cache the button
 		 * down event to allow for profile switching. The button will
-		 * act as a shift key and only send the input events when
-		 * released without pressing an additional button.
+		 * act as a shift key and only send the input events when no
+		 * additional button was pressed within the chord window, or
+		 * when released if there is no window.
 		 */
 
 		if (!xdata->shift_mode && (value == 1)) {
+			ktime_t window = events_shift_window(xdata);
+
 			/* cache this event */
 			xdata->shift_mode = true;
+			if (window) {
+				WRITE_ONCE(xdata->shift_state, XPADNEO_SHIFT_WAIT);
+				hrtimer_start(&xdata->shift_timer, window, HRTIMER_MODE_REL_SOFT);
+			}
 		} else if (xdata->shift_mode && (value == 0)) {
+			enum xpadneo_shift_state state;
+
+			/*
+			 * A timeout may be about to report its press: let it
+			 * finish, so our release cannot overtake it.
+			 */
+			hrtimer_cancel(&xdata->shift_timer);
+			state = xchg(&xdata->shift_state, XPADNEO_SHIFT_IDLE);
 			xdata->shift_mode = false;
-			if (xdata->profile_switched) {
+
+			if (state == XPADNEO_SHIFT_EMITTED) {
+				/* forward the real release */
+				input_report_key(gamepad, BTN_XBOX, 0);
+				input_sync(gamepad);
+			} else if (xdata->profile_switched) {
 				xdata->profile_switched = false;
 			} else {
 				/* replay cached event */
@@ -219,6 +498,14 @@ int xpadneo_events_event(struct hid_device *hdev, struct hid_field *field,
 		/* move the Share button to the keyboard device */
 		if (!keyboard)
 			goto keyboard_missing;
+		WRITE_ONCE(xdata->share_held, value);
+		if (!xpadneo_subdevice_ready(&xdata->keyboard)) {
+			/* register the keyboard on first use, the press will be replayed */
+			if (value)
+				xpadneo_synthetic_request(xdata, BIT(XPADNEO_SYNTHETIC_KEYBOARD)
+							  | BIT(XPADNEO_SYNTHETIC_REPLAY_SHARE));
+			goto stop_processing;
+		}
 		input_report_key(keyboard, BTN_SHARE, value);
 		xdata->keyboard.sync = true;
 		goto stop_processing;
@@ -228,31 +515,30 @@ int xpadneo_events_event(struct hid_device *hdev, struct hid_field *field,
 		if (!xdata->capabilities.hw_profiles) {
 			switch (usage->code) {
 			case BTN_A:
-				if (value == 1)
-					switch_profile(xdata, 0, true);
-				goto stop_processing;
 			case BTN_B:
-				if (value == 1)
-					switch_profile(xdata, 1, true);
-				goto stop_processing;
 			case BTN_X:
-				if (value == 1)
-					switch_profile(xdata, 2, true);
-				goto stop_processing;
 			case BTN_Y:
+				if (!events_shift_chord(xdata, value))
+					break;
 				if (value == 1)
-					switch_profile(xdata, 3, true);
+					switch_profile(xdata, events_profile_chord(usage->code), true);
 				goto stop_processing;
 			}
 		}
 		switch (usage->code) {
 		case BTN_SELECT:
+			if (!events_shift_chord(xdata, value))
+				break;
 			if ((value == 1) && xpadneo_mouse_toggle(xdata))
 				xdata->profile_switched = true;
 			goto stop_processing;
 		}
 	}
 
+	/* turbo buttons and macros report their buttons themselves */
+	if (xpadneo_turbo_event(xdata, usage, value))
+		goto stop_processing;
+
 	/* Let hid-core handle the event */
 	xdata->gamepad.sync = true;
 	return 0;
@@ -276,10 +562,26 @@ stop_processing:
 	return 1;
 }
 
+int xpadneo_events_event(struct hid_device *hdev, struct hid_field *field,
+			 struct hid_usage *usage, __s32 value)
+{
+	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
+	unsigned long flags;
+	int ret;
+
+	/* the settle timer of the axis filter replays events, too */
+	spin_lock_irqsave(&xdata->axis_filter.lock, flags);
+	ret = xpadneo_events_event_locked(hdev, field, usage, value);
+	spin_unlock_irqrestore(&xdata->axis_filter.lock, flags);
+
+	return ret;
+}
+
 int xpadneo_events_input_configured(struct hid_device *hdev, struct hid_input *hi)
 {
 	struct xpadneo_devdata *xdata = hid_get_drvdata(hdev);
-	int deadzone = 3072, abs_min = 0, abs_max = 65535;
+	int deadzone = XPADNEO_GAMEPAD_DEADZONE, abs_min = 0, abs_max = 65535;
+	bool disable_deadzones;
 
 	switch (hi->application) {
 	case HID_GD_GAMEPAD:
@@ -309,7 +611,11 @@ int xpadneo_events_input_configured(struct hid_device *hdev, struct hid_input *h
 		return 0;
 	}
 
-	if (param_disable_deadzones) {
+	rcu_read_lock();
+	disable_deadzones = xpadneo_config_flat_disabled(&rcu_dereference(xdata->config)->settings);
+	rcu_read_unlock();
+
+	if (disable_deadzones) {
 		hid_warn(hdev, "disabling dead zones\n");
 		deadzone = 0;
 	}
@@ -353,3 +659,100 @@ int xpadneo_events_input_configured(struct hid_device *hdev, struct hid_input *h
 
 	return 0;
 }
+
+/* release all keys still held on an input device */
+static void events_release_keys(struct input_dev *idev)
+{
+	unsigned int code;
+
+	for_each_set_bit(code, idev->key, KEY_CNT)
+		input_report_key(idev, code, 0);
+
+	input_sync(idev);
+}
+
+/*
+ * xpadneo_events_release - release all inputs of a controller which powers off
+ *
+ * Centers the sticks and releases triggers and buttons on all sub devices, so
+ * games do not keep acting on the last state until the link times out.
+ */
+void xpadneo_events_release(struct xpadneo_devdata *xdata)
+{
+	struct input_dev *gamepad = xdata->gamepad.idev;
+	s32 center = param_gamepad_compliance ? 0 : 32768;
+
+	/* the first report after powering on again must apply completely */
+	memset(xdata->input_report_0x01, 0, sizeof(xdata->input_report_0x01));
+
+	xpadneo_turbo_stop(xdata);
+
+	xdata->shift_mode = false;
+	xdata->profile_switched = false;
+	hrtimer_cancel(&xdata->shift_timer);
+	WRITE_ONCE(xdata->shift_state, XPADNEO_SHIFT_IDLE);
+	xdata->last_abs_z = 0;
+	xdata->last_abs_rz = 0;
+	memset(xdata->trigger_pressed, 0, sizeof(xdata->trigger_pressed));
+	memset(&xdata->sticks, 0, sizeof(xdata->sticks));
+	xpadneo_filter_reset(xdata);
+	WRITE_ONCE(xdata->share_held, false);
+
+	if (gamepad) {
+		input_report_abs(gamepad, ABS_X, center);
+		input_report_abs(gamepad, ABS_Y, center);
+		input_report_abs(gamepad, ABS_RX, center);
+		input_report_abs(gamepad, ABS_RY, center);
+		input_report_abs(gamepad, ABS_Z, 0);
+		input_report_abs(gamepad, ABS_RZ, 0);
+		input_report_abs(gamepad, ABS_HAT0X, 0);
+		input_report_abs(gamepad, ABS_HAT0Y, 0);
+		events_release_keys(gamepad);
+		xdata->gamepad.sync = false;
+	}
+
+	if (xpadneo_subdevice_ready(&xdata->keyboard)) {
+		events_release_keys(xdata->keyboard.idev);
+		xdata->keyboard.sync = false;
+	}
+
+	if (xpadneo_subdevice_ready(&xdata->consumer)) {
+		events_release_keys(xdata->consumer.idev);
+		xdata->consumer.sync = false;
+	}
+
+	if (xpadneo_subdevice_ready(&xdata->mouse)) {
+		events_release_keys(xdata->mouse.idev);
+		xdata->mouse.sync = false;
+	}
+
+	xpadneo_state_release(xdata);
+}
+
+void xpadneo_events_init_timer(struct xpadneo_devdata *xdata)
+{
+	/* armed by the Xbox button in shift mode */
+	hrtimer_setup(&xdata->shift_timer, events_shift_timeout, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL_SOFT);
+}
+
+void xpadneo_events_remove_timer(struct xpadneo_devdata *xdata)
+{
+	hrtimer_cancel(&xdata->shift_timer);
+}
+
+void xpadneo_events_update_deadzones(struct xpadneo_devdata *xdata, bool disabled)
+{
+	struct input_dev *gamepad = xdata->gamepad.idev;
+	int flat = disabled ? 0 : XPADNEO_GAMEPAD_DEADZONE;
+
+	/* nothing to do before the gamepad is configured */
+	if (!gamepad)
+		return;
+
+	hid_info(xdata->hdev, "%s dead zones\n", disabled ? "disabling" : "enabling");
+	input_abs_set_flat(gamepad, ABS_X, flat);
+	input_abs_set_flat(gamepad, ABS_Y, flat);
+	input_abs_set_flat(gamepad, ABS_RX, flat);
+	input_abs_set_flat(gamepad, ABS_RY, flat);
+}
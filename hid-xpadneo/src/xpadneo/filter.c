@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo axis jitter filter
+ *
+ * Adaptive low-pass filter in the style of the 1€ filter: the cutoff
+ * frequency rises with the speed of the axis, so noise at rest is removed
+ * while fast motion passes without lag. Values which do not change after
+ * filtering are not reported at all, saving wakeups of every reader.
+ *
+ * The filter only advances with reports, and the controller stops sending
+ * them at rest. An input which did not change is reported as is unless it is
+ * within the hysteresis of the last output, and a timer feeds the last inputs
+ * again once the reports stopped, so the output does not stay behind the real
+ * position.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/math64.h>
+
+#include "xpadneo.h"
+
+/* always include last */
+#include "compat.h"
+
+/* 2 * pi in Q16 */
+#define FILTER_TWO_PI_Q16 411775
+
+/* cutoff frequency of the speed estimation in mHz */
+#define FILTER_DERIVATE_CUTOFF 1000
+
+/* fractional bits kept in the filter state */
+#define FILTER_FRAC_BITS 8
+
+/* triggers are scaled to the stick range so the same tuning applies */
+#define FILTER_TRIGGER_SHIFT 6
+
+/* changes smaller than this (in stick units) are not reported */
+#define FILTER_HYSTERESIS 4
+
+/* highest cutoff frequency in mHz, the filter is transparent far below that */
+#define FILTER_MAX_CUTOFF 1000000
+
+/* longest step between reports, the filter restarts after a longer pause */
+#define FILTER_MAX_DT_US 100000
+
+/* time without reports after which the output settles to the last input */
+#define FILTER_SETTLE_MS 50
+
+static int filter_index(unsigned int code)
+{
+	switch (code) {
+	case ABS_X:
+		return 0;
+	case ABS_Y:
+		return 1;
+	case ABS_RX:
+		return 2;
+	case ABS_RY:
+		return 3;
+	case ABS_Z:
+		return 4;
+	case ABS_RZ:
+		return 5;
+	default:
+		return -1;
+	}
+}
+
+/* smoothing factor in Q16 for a cutoff frequency in mHz and a time step in us */
+static inline s64 filter_alpha(u32 cutoff, u32 dt)
+{
+	u64 a = div_u64((u64)FILTER_TWO_PI_Q16 * cutoff * dt, 1000000000);
+
+	return div64_u64(a << 16, a + BIT(16));
+}
+
+/*
+ * The lock serializes us with the event callbacks, which take it for each
+ * usage and for the end of the report. A report which started after our
+ * check only continues when we are done, and overwrites the replayed values.
+ */
+static enum hrtimer_restart filter_settle(struct hrtimer *t)
+{
+	struct xpadneo_devdata *xdata =
+	    container_of(t, struct xpadneo_devdata, axis_filter.settle_timer);
+	struct hid_device *hdev = xdata->hdev;
+	struct xpadneo_axis_filter *f;
+	unsigned long flags;
+	ktime_t idle;
+
+	spin_lock_irqsave(&xdata->axis_filter.lock, flags);
+
+	/* the controller is still reporting, wait for the rest of the period */
+	idle = ktime_sub(ktime_get(), xdata->report_time);
+	if (ktime_before(idle, ms_to_ktime(FILTER_SETTLE_MS))) {
+		hrtimer_start(t, ktime_sub(ms_to_ktime(FILTER_SETTLE_MS), idle),
+			      HRTIMER_MODE_REL_SOFT);
+		goto out;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(xdata->axis_filter.axes); i++) {
+		f = &xdata->axis_filter.axes[i];
+		if (f->valid && (f->out != f->in))
+			xpadneo_events_event_locked(hdev, f->field, f->usage, f->in);
+	}
+	xpadneo_device_report_locked(xdata);
+
+out:
+	spin_unlock_irqrestore(&xdata->axis_filter.lock, flags);
+	return HRTIMER_NORESTART;
+}
+
+void xpadneo_filter_init_timer(struct xpadneo_devdata *xdata)
+{
+	spin_lock_init(&xdata->axis_filter.lock);
+	hrtimer_setup(&xdata->axis_filter.settle_timer, filter_settle, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL_SOFT);
+}
+
+/*
+ * xpadneo_filter_axis - filter an axis value in place
+ *
+ * Returns XPADNEO_FILTER_BYPASS if the filter is disabled or not used for
+ * this axis, XPADNEO_FILTER_SUPPRESS if the filtered value did not change,
+ * or XPADNEO_FILTER_PASS if the filtered value should be reported.
+ */
+enum xpadneo_filter_result xpadneo_filter_axis(struct xpadneo_devdata *xdata,
+					       struct hid_field *field, struct hid_usage *usage,
+					       s32 *value)
+{
+	int index = filter_index(usage->code);
+	const struct xpadneo_settings *settings;
+	struct xpadneo_axis_filter *f;
+	u32 min_cutoff, beta, cutoff, dt;
+	int shift = FILTER_FRAC_BITS;
+	s64 x, dx;
+	bool enabled;
+
+	if (index < 0)
+		return XPADNEO_FILTER_BYPASS;
+
+	rcu_read_lock();
+	settings = &rcu_dereference(xdata->config)->settings;
+	enabled = settings->axis_filter;
+	min_cutoff = settings->axis_filter_min_cutoff;
+	beta = settings->axis_filter_beta;
+	rcu_read_unlock();
+
+	f = &xdata->axis_filter.axes[index];
+	if (!enabled) {
+		f->valid = false;
+		return XPADNEO_FILTER_BYPASS;
+	}
+
+	if ((usage->code == ABS_Z) || (usage->code == ABS_RZ))
+		shift += FILTER_TRIGGER_SHIFT;
+
+	xdata->axis_filter.received++;
+	f->field = field;
+	f->usage = usage;
+
+	x = (s64)*value << shift;
+	dt = clamp_t(s64, ktime_us_delta(xdata->report_time, f->time), 0, FILTER_MAX_DT_US);
+	f->time = xdata->report_time;
+
+	if (!f->valid || (dt >= FILTER_MAX_DT_US)) {
+		/* (re)start from the current value */
+		f->valid = true;
+		f->x_hat = x;
+		f->dx_hat = 0;
+		f->in = *value;
+		f->out = *value;
+		return XPADNEO_FILTER_PASS;
+	}
+
+	/* the axis is at rest, jump to the input instead of creeping towards it */
+	if (*value == f->in) {
+		f->x_hat = x;
+		f->dx_hat = 0;
+		if (abs(x - ((s64)f->out << shift)) < (FILTER_HYSTERESIS << FILTER_FRAC_BITS)) {
+			xdata->axis_filter.suppressed++;
+			return XPADNEO_FILTER_SUPPRESS;
+		}
+
+		f->out = *value;
+		return XPADNEO_FILTER_PASS;
+	}
+	f->in = *value;
+
+	/* settle the output if the controller stops reporting before the input repeats */
+	if (!hrtimer_is_queued(&xdata->axis_filter.settle_timer))
+		hrtimer_start(&xdata->axis_filter.settle_timer, ms_to_ktime(FILTER_SETTLE_MS),
+			      HRTIMER_MODE_REL_SOFT);
+
+	/* reports with the same timestamp do not advance the filter */
+	if (dt) {
+		/* speed in units per ms, also smoothed */
+		dx = div_s64((x - f->x_hat) * 1000, dt);
+		f->dx_hat += ((dx - f->dx_hat) * filter_alpha(FILTER_DERIVATE_CUTOFF, dt)) >> 16;
+
+		/* faster movement raises the cutoff frequency to reduce lag */
+		cutoff = min_t(u64, min_cutoff + (u64)beta * (abs(f->dx_hat) >> shift),
+			       FILTER_MAX_CUTOFF);
+		f->x_hat += ((x - f->x_hat) * filter_alpha(cutoff, dt)) >> 16;
+	}
+
+	/* residual noise of the filtered value is still not worth a wakeup */
+	if (abs(f->x_hat - ((s64)f->out << shift)) < (FILTER_HYSTERESIS << FILTER_FRAC_BITS)) {
+		xdata->axis_filter.suppressed++;
+		return XPADNEO_FILTER_SUPPRESS;
+	}
+
+	*value = (f->x_hat + BIT(shift - 1)) >> shift;
+	f->out = *value;
+	return XPADNEO_FILTER_PASS;
+}
+
+/* restart all axes from the next report */
+void xpadneo_filter_reset(struct xpadneo_devdata *xdata)
+{
+	for (int i = 0; i < ARRAY_SIZE(xdata->axis_filter.axes); i++)
+		xdata->axis_filter.axes[i].valid = false;
+
+	hrtimer_try_to_cancel(&xdata->axis_filter.settle_timer);
+}
+
+void xpadneo_filter_remove_timer(struct xpadneo_devdata *xdata)
+{
+	hrtimer_cancel(&xdata->axis_filter.settle_timer);
+}
@@ -24,11 +24,11 @@ do {							\
 /* benchmark helper */
 #define xpadneo_benchmark(name, ...)					\
 do {									\
-	unsigned long __##name##_jiffies = jiffies;			\
+	ktime_t __##name##_start = ktime_get();				\
 	pr_info("xpadneo " #name " start\n");				\
 	name(__VA_ARGS__);						\
-	pr_info("xpadneo " #name " took %ums\n",			\
-		jiffies_to_msecs(jiffies - __##name##_jiffies));	\
+	pr_info("xpadneo " #name " took %lldus\n",			\
+		ktime_us_delta(ktime_get(), __##name##_start));		\
 } while (0)
 
 /* generic helpers */
@@ -13,7 +13,8 @@ int xpadneo_keyboard_init(struct xpadneo_devdata *xdata)
 	int ret;
 
 	if (!xdata->keyboard.idev) {
-		ret = xpadneo_synthetic_init(xdata, "Keyboard", &xdata->keyboard);
+		ret = xpadneo_synthetic_init(xdata, "Keyboard", &xdata->keyboard,
+					     XPADNEO_SYNTHETIC_KEYBOARD);
 		if (ret || !xdata->keyboard.idev)
 			return ret;
 	}
@@ -33,10 +34,6 @@ int xpadneo_keyboard_init(struct xpadneo_devdata *xdata)
 		input_set_capability(keyboard, EV_KEY, KEY_DOWN);
 	} while (0);
 
-	ret = xpadneo_synthetic_register(xdata, "keyboard", &xdata->keyboard);
-	if (ret)
-		return ret;
-
 	return 0;
 }
 
@@ -18,11 +18,73 @@ module_param_named(disable_mouse, param_disable_mouse, bool, 0444);
 MODULE_PARM_DESC(disable_mouse,
 		 "(bool) Disable mouse device permanently. 0: allow mouse, 1: disallow mouse.");
 
-/* Mouse movement deadzone and trigger thresholds (raw values) */
-#define XPADNEO_MOUSE_MOVEMENT_DEADZONE   3072
+static unsigned int param_mouse_click_haptics = 30;
+module_param_named(mouse_click_haptics, param_mouse_click_haptics, uint, 0644);
+MODULE_PARM_DESC(mouse_click_haptics,
+		 "(uint) Trigger rumble strength when a trigger clicks in mouse mode. "
+		 "0: disable, 1..100: percent of full strength.");
+
+/* Mouse button trigger thresholds (raw values) */
 #define XPADNEO_TRIGGER_RELEASE_THRESHOLD 384
 #define XPADNEO_TRIGGER_PRESS_THRESHOLD   640
 
+/* Mouse speed is tuned for this report rate, and scaled for the actual rate */
+#define XPADNEO_MOUSE_REFERENCE_RATE      100
+
+/* Movement units per pointer pixel and per wheel notch at the reference rate */
+#define XPADNEO_MOUSE_REL_UNITS           1024
+#define XPADNEO_MOUSE_WHEEL_UNITS         16384
+
+/* High-resolution wheel units per wheel notch */
+#define XPADNEO_MOUSE_WHEEL_HI_RES        120
+
+static inline s32 mouse_apply_curve(struct xpadneo_devdata *xdata, s32 value)
+{
+	s32 speed;
+
+	rcu_read_lock();
+	speed = xpadneo_curve_lookup(rcu_dereference(xdata->config)->mouse_lut, value);
+	rcu_read_unlock();
+
+	return speed;
+}
+
+static inline bool mouse_is_idle(const struct xpadneo_devdata *xdata)
+{
+	return !xdata->mouse_state.rel_x && !xdata->mouse_state.rel_y
+	    && !xdata->mouse_state.wheel_x && !xdata->mouse_state.wheel_y;
+}
+
+static inline void mouse_start_timer(struct xpadneo_devdata *xdata)
+{
+	const struct xpadneo_config *config;
+
+	/* the timer only runs while a stick is deflected, and stops itself otherwise */
+	if (mouse_is_idle(xdata))
+		return;
+
+	/* pairs with smp_mb() in mouse_report(), see there */
+	smp_mb();
+	if (READ_ONCE(xdata->mouse_state.ticking)
+	    || cmpxchg(&xdata->mouse_state.ticking, false, true))
+		return;
+
+	/* the rate stays fixed while ticking so the error accumulators stay valid */
+	rcu_read_lock();
+	config = rcu_dereference(xdata->config);
+	if (xdata->mouse_state.rate != config->mouse_rate) {
+		xdata->mouse_state.rate = config->mouse_rate;
+		xdata->mouse_state.period = config->mouse_period;
+		xdata->mouse_state.rel_x_err = 0;
+		xdata->mouse_state.rel_y_err = 0;
+		xdata->mouse_state.wheel_x_err = 0;
+		xdata->mouse_state.wheel_y_err = 0;
+	}
+	rcu_read_unlock();
+
+	hrtimer_start(&xdata->mouse_timer, 0, HRTIMER_MODE_REL_SOFT);
+}
+
 bool xpadneo_mouse_toggle(struct xpadneo_devdata *xdata)
 {
 	if (!xdata->mouse.idev) {
@@ -31,8 +93,19 @@ bool xpadneo_mouse_toggle(struct xpadneo_devdata *xdata)
 		return false;
 	} else if (xdata->mouse_mode) {
 		xdata->mouse_mode = false;
+		/* do not move the pointer from stale stick positions when enabled again */
+		xdata->mouse_state.rel_x = 0;
+		xdata->mouse_state.rel_y = 0;
+		xdata->mouse_state.wheel_x = 0;
+		xdata->mouse_state.wheel_y = 0;
 		hid_info(xdata->hdev, "mouse mode disabled\n");
 	} else {
+		/* register the devices used by mouse mode on first use */
+		xpadneo_synthetic_request(xdata, BIT(XPADNEO_SYNTHETIC_CONSUMER)
+					  | BIT(XPADNEO_SYNTHETIC_KEYBOARD)
+					  | BIT(XPADNEO_SYNTHETIC_MOUSE));
+		/* mouse mode takes over the buttons, their releases would not stop turbo */
+		xpadneo_turbo_stop(xdata);
 		xdata->mouse_mode = true;
 		hid_info(xdata->hdev, "mouse mode enabled\n");
 	}
@@ -41,36 +114,79 @@ bool xpadneo_mouse_toggle(struct xpadneo_devdata *xdata)
 	return true;
 }
 
-#define mouse_report_rel(a,v) if((v)!=0)input_report_rel(mouse,(a),(v))
-void xpadneo_mouse_report(struct timer_list *t)
+static inline void mouse_report_rel(struct xpadneo_devdata *xdata, unsigned int code,
+				    s32 speed, s32 *err)
 {
-	__s32 value;
+	s32 value, div = XPADNEO_MOUSE_REL_UNITS * xdata->mouse_state.rate;
+
+	/* keep the sub-pixel error for the next tick */
+	value = speed * XPADNEO_MOUSE_REFERENCE_RATE + *err;
+	*err = value % div;
+	value /= div;
 
-	struct xpadneo_devdata *xdata = timer_container_of(xdata, t, mouse_timer);
-	struct input_dev *mouse = xdata->mouse.idev;
+	if (value)
+		input_report_rel(xdata->mouse.idev, code, value);
+}
 
-	mod_timer(&xdata->mouse_timer, jiffies + msecs_to_jiffies(10));
+static inline void mouse_report_wheel(struct xpadneo_devdata *xdata, unsigned int code,
+				      unsigned int code_hi_res, s32 speed, s32 *err, s32 *hi_res)
+{
+	s32 value, div = XPADNEO_MOUSE_WHEEL_UNITS * xdata->mouse_state.rate;
 
-	if (xdata->mouse_mode) {
-		value = xdata->mouse_state.rel_x + xdata->mouse_state.rel_x_err;
-		xdata->mouse_state.rel_x_err = value % 1024;
-		mouse_report_rel(REL_X, value / 1024);
+	/* keep the sub-unit error for the next tick */
+	value = speed * XPADNEO_MOUSE_REFERENCE_RATE * XPADNEO_MOUSE_WHEEL_HI_RES + *err;
+	*err = value % div;
+	value /= div;
 
-		value = xdata->mouse_state.rel_y + xdata->mouse_state.rel_y_err;
-		xdata->mouse_state.rel_y_err = value % 1024;
-		mouse_report_rel(REL_Y, value / 1024);
+	if (!value)
+		return;
 
-		value = xdata->mouse_state.wheel_x + xdata->mouse_state.wheel_x_err;
-		xdata->mouse_state.wheel_x_err = value % 16384;
-		mouse_report_rel(REL_HWHEEL, value / 16384);
+	input_report_rel(xdata->mouse.idev, code_hi_res, value);
 
-		value = xdata->mouse_state.wheel_y + xdata->mouse_state.wheel_y_err;
-		xdata->mouse_state.wheel_y_err = value % 16384;
-		mouse_report_rel(REL_WHEEL, value / 16384);
+	/* emit a legacy wheel event for every full notch */
+	*hi_res += value;
+	if (abs(*hi_res) >= XPADNEO_MOUSE_WHEEL_HI_RES) {
+		input_report_rel(xdata->mouse.idev, code, *hi_res / XPADNEO_MOUSE_WHEEL_HI_RES);
+		*hi_res %= XPADNEO_MOUSE_WHEEL_HI_RES;
+	}
+}
 
-		input_sync(xdata->mouse.idev);
+static enum hrtimer_restart mouse_report(struct hrtimer *t)
+{
+	struct xpadneo_devdata *xdata = container_of(t, struct xpadneo_devdata, mouse_timer);
+
+	/* let the timer expire if there is nothing to report */
+	if (!xdata->mouse_mode || mouse_is_idle(xdata)) {
+		WRITE_ONCE(xdata->mouse_state.ticking, false);
+
+		/*
+		 * Either we see the stick movement which raced with us here, or
+		 * mouse_start_timer() sees that we stopped ticking and starts
+		 * the timer again.
+		 */
+		smp_mb();
+		if (!xdata->mouse_mode || mouse_is_idle(xdata)
+		    || cmpxchg(&xdata->mouse_state.ticking, false, true))
+			return HRTIMER_NORESTART;
 	}
 
+	hrtimer_forward_now(t, xdata->mouse_state.period);
+
+	/* keep ticking until the lazily registered mouse is ready */
+	if (!xpadneo_subdevice_ready(&xdata->mouse))
+		return HRTIMER_RESTART;
+
+	mouse_report_rel(xdata, REL_X, xdata->mouse_state.rel_x, &xdata->mouse_state.rel_x_err);
+	mouse_report_rel(xdata, REL_Y, xdata->mouse_state.rel_y, &xdata->mouse_state.rel_y_err);
+
+	mouse_report_wheel(xdata, REL_HWHEEL, REL_HWHEEL_HI_RES, xdata->mouse_state.wheel_x,
+			   &xdata->mouse_state.wheel_x_err, &xdata->mouse_state.wheel_x_hi_res);
+	mouse_report_wheel(xdata, REL_WHEEL, REL_WHEEL_HI_RES, xdata->mouse_state.wheel_y,
+			   &xdata->mouse_state.wheel_y_err, &xdata->mouse_state.wheel_y_hi_res);
+
+	input_sync(xdata->mouse.idev);
+
+	return HRTIMER_RESTART;
 }
 
 int xpadneo_mouse_raw_event(struct xpadneo_devdata *xdata, struct hid_report *report,
@@ -86,13 +202,22 @@ int xpadneo_mouse_raw_event(struct xpadneo_devdata *xdata, struct hid_report *re
 static inline void report_key_and_sync(struct xpadneo_subdevice *subdev, unsigned int code,
 				       int value)
 {
-	if (subdev->idev) {
+	/* lazily registered devices may not be ready yet */
+	if (xpadneo_subdevice_ready(subdev)) {
 		input_report_key(subdev->idev, code, value);
 		subdev->sync = true;
 	}
 }
 
-#define rescale_axis(v,d) (((v)<(d)&&(v)>-(d))?0:(32768*((v)>0?(v)-(d):(v)+(d))/(32768-(d))))
+/* short pulse of the trigger motor when the trigger crosses a click threshold */
+static void mouse_click_haptics(struct xpadneo_devdata *xdata, enum xpadneo_rumble_motors motor)
+{
+	unsigned int strength = READ_ONCE(param_mouse_click_haptics);
+
+	if (strength)
+		xpadneo_rumble_click(xdata, motor, strength);
+}
+
 #define digipad(v,v1,v2,v3) (((v==(v1))||(v==(v2))||(v==(v3)))?1:0)
 int xpadneo_mouse_event(struct xpadneo_devdata *xdata, struct hid_usage *usage, __s32 value)
 {
@@ -105,43 +230,45 @@ int xpadneo_mouse_event(struct xpadneo_devdata *xdata, struct hid_usage *usage,
 	if (usage->type == EV_ABS) {
 		switch (usage->code) {
 		case ABS_X:
-			xdata->mouse_state.rel_x =
-			    rescale_axis(value - 32768, XPADNEO_MOUSE_MOVEMENT_DEADZONE);
+			xdata->mouse_state.rel_x = mouse_apply_curve(xdata, value - 32768);
+			mouse_start_timer(xdata);
 			return 1;
 		case ABS_Y:
-			xdata->mouse_state.rel_y =
-			    rescale_axis(value - 32768, XPADNEO_MOUSE_MOVEMENT_DEADZONE);
+			xdata->mouse_state.rel_y = mouse_apply_curve(xdata, value - 32768);
+			mouse_start_timer(xdata);
 			return 1;
 		case ABS_RX:
-			xdata->mouse_state.wheel_x =
-			    rescale_axis(value - 32768, XPADNEO_MOUSE_MOVEMENT_DEADZONE);
+			xdata->mouse_state.wheel_x = mouse_apply_curve(xdata, value - 32768);
+			mouse_start_timer(xdata);
 			return 1;
 		case ABS_RY:
-			xdata->mouse_state.wheel_y =
-			    rescale_axis(value - 32768, XPADNEO_MOUSE_MOVEMENT_DEADZONE);
+			xdata->mouse_state.wheel_y = mouse_apply_curve(xdata, value - 32768);
+			mouse_start_timer(xdata);
 			return 1;
 		case ABS_RZ:
-			/* TODO: Implement haptic feedback */
 			if (xdata->mouse_state.analog_button.left
 			    && value < XPADNEO_TRIGGER_RELEASE_THRESHOLD) {
 				xdata->mouse_state.analog_button.left = false;
 				report_key_and_sync(&xdata->mouse, BTN_LEFT, 0);
+				mouse_click_haptics(xdata, XBOX_RUMBLE_RIGHT);
 			} else if (!xdata->mouse_state.analog_button.left
 				   && value > XPADNEO_TRIGGER_PRESS_THRESHOLD) {
 				xdata->mouse_state.analog_button.left = true;
 				report_key_and_sync(&xdata->mouse, BTN_LEFT, 1);
+				mouse_click_haptics(xdata, XBOX_RUMBLE_RIGHT);
 			}
 			return 1;
 		case ABS_Z:
-			/* TODO: Implement haptic feedback */
 			if (xdata->mouse_state.analog_button.right
 			    && value < XPADNEO_TRIGGER_RELEASE_THRESHOLD) {
 				xdata->mouse_state.analog_button.right = false;
 				report_key_and_sync(&xdata->mouse, BTN_RIGHT, 0);
+				mouse_click_haptics(xdata, XBOX_RUMBLE_LEFT);
 			} else if (!xdata->mouse_state.analog_button.right
 				   && value > XPADNEO_TRIGGER_PRESS_THRESHOLD) {
 				xdata->mouse_state.analog_button.right = true;
 				report_key_and_sync(&xdata->mouse, BTN_RIGHT, 1);
+				mouse_click_haptics(xdata, XBOX_RUMBLE_LEFT);
 			}
 			return 1;
 		case ABS_HAT0X:
@@ -183,7 +310,8 @@ int xpadneo_mouse_event(struct xpadneo_devdata *xdata, struct hid_usage *usage,
 			 * if the Xbox button is pressed, ignore this event to allow turning
 			 * mouse mode off
 			 */
-			if (xdata->shift_mode)
+			if (xdata->shift_mode
+			    && (READ_ONCE(xdata->shift_state) != XPADNEO_SHIFT_EMITTED))
 				break;
 			report_key_and_sync(&xdata->mouse, BTN_BACK, value);
 			return 1;
@@ -218,7 +346,8 @@ int xpadneo_mouse_init(struct xpadneo_devdata *xdata)
 	}
 
 	if (!xdata->mouse.idev) {
-		ret = xpadneo_synthetic_init(xdata, "Mouse", &xdata->mouse);
+		ret = xpadneo_synthetic_init(xdata, "Mouse", &xdata->mouse,
+					     XPADNEO_SYNTHETIC_MOUSE);
 		if (ret || !xdata->mouse.idev)
 			return ret;
 	}
@@ -232,6 +361,8 @@ int xpadneo_mouse_init(struct xpadneo_devdata *xdata)
 		__set_bit(REL_Y, mouse->relbit);
 		__set_bit(REL_HWHEEL, mouse->relbit);
 		__set_bit(REL_WHEEL, mouse->relbit);
+		__set_bit(REL_HWHEEL_HI_RES, mouse->relbit);
+		__set_bit(REL_WHEEL_HI_RES, mouse->relbit);
 
 		/* enable button events for mouse emulation */
 		__set_bit(EV_KEY, mouse->evbit);
@@ -245,10 +376,6 @@ int xpadneo_mouse_init(struct xpadneo_devdata *xdata)
 		__set_bit(BTN_TASK, mouse->keybit);
 	} while (0);
 
-	ret = xpadneo_synthetic_register(xdata, "mouse", &xdata->mouse);
-	if (ret)
-		return ret;
-
 	return 0;
 }
 
@@ -257,8 +384,26 @@ void xpadneo_mouse_init_timer(struct xpadneo_devdata *xdata)
 	if (param_disable_mouse)
 		return;
 
-	timer_setup(&xdata->mouse_timer, xpadneo_mouse_report, 0);
-	mod_timer(&xdata->mouse_timer, jiffies);
+	/* armed by stick movement while in mouse mode */
+	hrtimer_setup(&xdata->mouse_timer, mouse_report, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+}
+
+/* stop the pointer without sleeping, stick movement re-arms the timer */
+void xpadneo_mouse_stop(struct xpadneo_devdata *xdata)
+{
+	if (param_disable_mouse)
+		return;
+
+	/* do not move on from a stale stick position, a running timer stops itself */
+	xdata->mouse_state.rel_x = 0;
+	xdata->mouse_state.rel_y = 0;
+	xdata->mouse_state.wheel_x = 0;
+	xdata->mouse_state.wheel_y = 0;
+	xdata->mouse_state.analog_button.left = false;
+	xdata->mouse_state.analog_button.right = false;
+
+	if (hrtimer_try_to_cancel(&xdata->mouse_timer) == 1)
+		WRITE_ONCE(xdata->mouse_state.ticking, false);
 }
 
 void xpadneo_mouse_remove_timer(struct xpadneo_devdata *xdata)
@@ -266,7 +411,7 @@ void xpadneo_mouse_remove_timer(struct xpadneo_devdata *xdata)
 	if (param_disable_mouse)
 		return;
 
-	timer_delete_sync(&xdata->mouse_timer);
+	hrtimer_cancel(&xdata->mouse_timer);
 }
 
 void xpadneo_mouse_remove(struct xpadneo_devdata *xdata)
@@ -7,11 +7,16 @@
  * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
  */
 
+#include <linux/math64.h>
 #include <linux/power_supply.h>
 
 #include "xpadneo.h"
 
+/* always include last */
+#include "compat.h"
+
 static enum power_supply_property xpadneo_battery_props[] = {
+	POWER_SUPPLY_PROP_CAPACITY,
 	POWER_SUPPLY_PROP_CAPACITY_LEVEL,
 	POWER_SUPPLY_PROP_MODEL_NAME,
 	POWER_SUPPLY_PROP_ONLINE,
@@ -31,6 +36,16 @@ static enum power_supply_property xpadneo_battery_props[] = {
 #define XPADNEO_BATTERY_CHARGING(data)       ((data&0x10) > 0)
 #define XPADNEO_BATTERY_CAPACITY_LEVEL(data) (data&0x03)
 
+/* battery changes must be stable this long before they are published */
+#define XPADNEO_BATTERY_DEBOUNCE_MS 5000
+
+/* refresh interval of the capacity estimate, and the change worth a uevent */
+#define XPADNEO_BATTERY_REFRESH_MS  60000
+#define XPADNEO_BATTERY_NOTIFY_STEP 5
+
+/* assumed capacity range of each level in percent, level n spans bounds n to n + 1 */
+static const u8 battery_level_bounds[] = { 0, 10, 40, 70, 100 };
+
 static int get_psy_property(struct power_supply *psy,
 			    enum power_supply_property property, union power_supply_propval *val)
 {
@@ -44,7 +59,7 @@ static int get_psy_property(struct power_supply *psy,
 		[3] = POWER_SUPPLY_CAPACITY_LEVEL_FULL,
 	};
 
-	u8 flags = xdata->battery.flags;
+	u8 flags = READ_ONCE(xdata->battery.published);
 
 	/*
 	 * Clamp to the known power_supply range until higher-capacity states are modeled
@@ -55,6 +70,13 @@ static int get_psy_property(struct power_supply *psy,
 	bool charging = XPADNEO_BATTERY_CHARGING(flags);
 
 	switch (property) {
+	case POWER_SUPPLY_PROP_CAPACITY:
+		if (online && XPADNEO_BATTERY_ONLINE(flags))
+			val->intval = READ_ONCE(xdata->battery.capacity);
+		else
+			ret = -ENODATA;
+		break;
+
 	case POWER_SUPPLY_PROP_CAPACITY_LEVEL:
 		if (online && XPADNEO_BATTERY_ONLINE(flags))
 			val->intval = capacity_level_map[level];
@@ -139,9 +161,119 @@ static int setup_psy(struct hid_device *hdev)
 	return 0;
 }
 
+/*
+ * called with the battery lock held, estimates the capacity within the range
+ * of the current level from the time the level was entered and the time the
+ * previous level took
+ */
+static u8 power_estimate_capacity(const struct xpadneo_devdata *xdata, ktime_t now)
+{
+	u8 flags = xdata->battery.published;
+	u8 level = min(3, XPADNEO_BATTERY_CAPACITY_LEVEL(flags));
+	s64 lo = battery_level_bounds[level], hi = battery_level_bounds[level + 1], delta;
+	bool charging = XPADNEO_BATTERY_CHARGING(flags);
+
+	/* without a transition, the middle of the level is the best guess */
+	if (!xdata->battery.level_entered)
+		return (lo + hi) / 2;
+
+	/* the level was entered at its lower bound when charging, at the upper otherwise */
+	if (!xdata->battery.level_ns_per_percent)
+		return charging ? lo : hi;
+
+	delta = div64_u64(ktime_to_ns(ktime_sub(now, xdata->battery.level_entered)),
+			  xdata->battery.level_ns_per_percent);
+
+	return clamp(charging ? lo + delta : hi - delta, lo, hi);
+}
+
+/* called with the battery lock held, learns the charge rate from level transitions */
+static void power_track_level(struct xpadneo_devdata *xdata, u8 old, u8 value, ktime_t now)
+{
+	int from = min(3, XPADNEO_BATTERY_CAPACITY_LEVEL(old));
+	int to = min(3, XPADNEO_BATTERY_CAPACITY_LEVEL(value));
+	bool charging = XPADNEO_BATTERY_CHARGING(value);
+	u64 width;
+
+	/* a changed power source or mode makes the rate meaningless */
+	if (!XPADNEO_PSY_ONLINE(old) || ((old ^ value) & 0x1C)) {
+		xdata->battery.level_entered = 0;
+		xdata->battery.level_ns_per_percent = 0;
+		return;
+	}
+
+	if (from == to)
+		return;
+
+	/* only a step into the direction of charging is a known point of the capacity */
+	if (to != (charging ? from + 1 : from - 1)) {
+		xdata->battery.level_entered = 0;
+		xdata->battery.level_ns_per_percent = 0;
+		return;
+	}
+
+	/* the whole previous level was crossed if we saw it being entered */
+	width = battery_level_bounds[from + 1] - battery_level_bounds[from];
+	if (xdata->battery.level_entered)
+		xdata->battery.level_ns_per_percent =
+		    div64_u64(ktime_to_ns(ktime_sub(now, xdata->battery.level_entered)), width);
+
+	xdata->battery.level_entered = now;
+}
+
+/* called with the battery lock held, makes the flags visible to the power supply */
+static void power_publish(struct xpadneo_devdata *xdata, u8 value)
+{
+	u8 old = xdata->battery.published, capacity;
+	ktime_t now = ktime_get();
+
+	/* the level only rises while charging, ignore readings flapping around a threshold */
+	if (XPADNEO_PSY_ONLINE(old) && XPADNEO_PSY_ONLINE(value)
+	    && !((old ^ value) & 0x1C) && !XPADNEO_BATTERY_CHARGING(value)
+	    && (XPADNEO_BATTERY_CAPACITY_LEVEL(value) > XPADNEO_BATTERY_CAPACITY_LEVEL(old)))
+		value = (value & ~0x03) | XPADNEO_BATTERY_CAPACITY_LEVEL(old);
+
+	power_track_level(xdata, old, value, now);
+	WRITE_ONCE(xdata->battery.published, value);
+
+	capacity = power_estimate_capacity(xdata, now);
+	WRITE_ONCE(xdata->battery.capacity, capacity);
+
+	if ((old == value)
+	    && (abs(capacity - xdata->battery.capacity_notified) < XPADNEO_BATTERY_NOTIFY_STEP))
+		return;
+
+	xdata->battery.capacity_notified = capacity;
+	power_supply_changed(xdata->battery.psy);
+}
+
+static enum hrtimer_restart power_timer(struct hrtimer *t)
+{
+	struct xpadneo_devdata *xdata = container_of(t, struct xpadneo_devdata, battery.timer);
+
+	guard(spinlock_irqsave)(&xdata->battery.lock);
+
+	if (!xdata->battery.psy || !XPADNEO_PSY_ONLINE(xdata->battery.flags))
+		return HRTIMER_NORESTART;
+
+	/* a change while we waited for the lock restarted the debounce */
+	if (hrtimer_is_queued(t))
+		return HRTIMER_NORESTART;
+
+	/* publish the settled flags, or refresh the estimate */
+	power_publish(xdata, xdata->battery.flags);
+
+	/* re-arm under the lock, so a battery report cannot queue the timer in between */
+	if (xdata->battery.level_ns_per_percent)
+		hrtimer_start(t, ms_to_ktime(XPADNEO_BATTERY_REFRESH_MS), HRTIMER_MODE_REL_SOFT);
+
+	return HRTIMER_NORESTART;
+}
+
 void xpadneo_power_update(struct xpadneo_devdata *xdata, u8 value)
 {
-	int old_value = xdata->battery.flags;
+	u8 old_value = xdata->battery.flags;
+	bool online;
 
 	if (!xdata->battery.initialized && XPADNEO_PSY_ONLINE(value)) {
 		xdata->battery.initialized = true;
@@ -152,10 +284,33 @@ void xpadneo_power_update(struct xpadneo_devdata *xdata, u8 value)
 		return;
 
 	xdata->battery.flags = value;
-	if (old_value != value) {
-		if (!XPADNEO_PSY_ONLINE(value))
+
+	/* powering on or off is published right away */
+	online = XPADNEO_PSY_ONLINE(value);
+	if (online != XPADNEO_PSY_ONLINE(READ_ONCE(xdata->battery.published))) {
+		if (!online) {
 			hid_info(xdata->hdev, "shutting down\n");
-		power_supply_changed(xdata->battery.psy);
+			xpadneo_core_power_off(xdata);
+			hrtimer_try_to_cancel(&xdata->battery.timer);
+		} else {
+			xpadneo_core_power_on(xdata);
+		}
+
+		scoped_guard(spinlock_irqsave, &xdata->battery.lock) {
+			if (xdata->battery.psy)
+				power_publish(xdata, value);
+		}
+		return;
+	}
+
+	/* everything else must settle first, each change restarts the wait */
+	if (old_value != value) {
+		scoped_guard(spinlock_irqsave, &xdata->battery.lock) {
+			if (xdata->battery.psy)
+				hrtimer_start(&xdata->battery.timer,
+					      ms_to_ktime(XPADNEO_BATTERY_DEBOUNCE_MS),
+					      HRTIMER_MODE_REL_SOFT);
+		}
 	}
 }
 
@@ -178,10 +333,32 @@ int xpadneo_power_init(struct xpadneo_devdata *xdata)
 	return 0;
 }
 
+/*
+ * HID core drops reports until the probe returns, but the error paths of the
+ * probe already stop the timer, so it must exist from the start.
+ */
+void xpadneo_power_init_timer(struct xpadneo_devdata *xdata)
+{
+	spin_lock_init(&xdata->battery.lock);
+	hrtimer_setup(&xdata->battery.timer, power_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+}
+
+void xpadneo_power_remove_timer(struct xpadneo_devdata *xdata)
+{
+	/* the power supply goes away with the device, stop publishing to it */
+	scoped_guard(spinlock_irqsave, &xdata->battery.lock) {
+		xdata->battery.psy = NULL;
+	}
+
+	hrtimer_cancel(&xdata->battery.timer);
+}
+
 void xpadneo_power_remove(struct xpadneo_devdata *xdata)
 {
 	struct hid_device *hdev = xdata->hdev;
 
+	xpadneo_power_remove_timer(xdata);
+
 	xdata->battery.name = NULL;
 	xdata->battery.name_pnc = NULL;
 
@@ -6,15 +6,177 @@
  * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
  */
 
+#include <linux/bsearch.h>
+#include <linux/etherdevice.h>
+#include <linux/firmware.h>
 #include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
 
 #include "xpadneo.h"
 
-static struct {
-	char *args[17];
-	unsigned int nargs;
-} param_quirks;
-module_param_array_named(quirks, param_quirks.args, charp, &param_quirks.nargs, 0644);
+/* number of MAC entries accepted by the quirks parameter */
+#define QUIRKS_PARAM_MAX 16
+
+/* largest quirks database accepted */
+#define QUIRKS_DB_MAX_SIZE (64 * 1024)
+
+struct quirks_override {
+	u8 mac[ETH_ALEN];
+	char modifier;		/* ':' replaces, '+' adds, '-' removes flags */
+	u32 flags;
+};
+
+/* the quirks parameter, parsed once when it is set */
+struct quirks_param {
+	struct rcu_head rcu;
+	unsigned int count;
+	struct quirks_override overrides[];
+};
+
+enum quirks_kind {
+	QUIRKS_KIND_OUI,
+	QUIRKS_KIND_CRC,
+	QUIRKS_KIND_NAME,
+};
+
+struct quirks_entry {
+	enum quirks_kind kind;
+	u32 key;		/* OUI or descriptor CRC-16 */
+	const char *name;	/* full device name */
+	u32 flags;
+};
+
+/* the quirks database loaded from the firmware directory, sorted for lookups */
+struct quirks_db {
+	unsigned int count;
+	char *text;		/* names point into this buffer */
+	struct quirks_entry entries[];
+};
+
+static struct quirks_param __rcu *quirks_param;
+
+static DEFINE_MUTEX(quirks_db_lock);
+static struct quirks_db __rcu *quirks_db;
+static bool quirks_db_loaded;
+static char param_quirks_db[64] = "xpadneo/quirks.txt";
+
+static int quirks_override_cmp(const void *a, const void *b)
+{
+	const struct quirks_override *x = a, *y = b;
+
+	return memcmp(x->mac, y->mac, ETH_ALEN);
+}
+
+static int quirks_param_parse(char *arg, struct quirks_override *override)
+{
+	char *flags;
+
+	arg = strim(arg);
+
+	/* "11:22:33:44:55:66" followed by the modifier */
+	if ((strlen(arg) < 3 * ETH_ALEN) || !mac_pton(arg, override->mac))
+		return -EINVAL;
+
+	override->modifier = arg[3 * ETH_ALEN - 1];
+	if ((override->modifier != ':') && (override->modifier != '+')
+	    && (override->modifier != '-'))
+		return -EINVAL;
+
+	flags = arg + 3 * ETH_ALEN;
+	return kstrtou32(flags, 0, &override->flags);
+}
+
+static int quirks_param_set(const char *val, const struct kernel_param *kp)
+{
+	struct quirks_param *table, *old;
+	char *buf, *p, *arg;
+	int ret = 0;
+
+	table = kzalloc(struct_size(table, overrides, QUIRKS_PARAM_MAX), GFP_KERNEL);
+	buf = kstrdup(val, GFP_KERNEL);
+	if (!table || !buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	p = buf;
+	while ((arg = strsep(&p, ",")) != NULL) {
+		struct quirks_override *override = &table->overrides[table->count];
+
+		if (!*strim(arg))
+			continue;
+
+		if (table->count >= QUIRKS_PARAM_MAX) {
+			pr_warn("hid-xpadneo quirks: more than %d entries\n", QUIRKS_PARAM_MAX);
+			ret = -E2BIG;
+			goto out;
+		}
+
+		if (quirks_param_parse(arg, override)) {
+			pr_warn("hid-xpadneo quirks: '%s' invalid, expected MAC{:,+,-}flags\n",
+				strim(arg));
+			ret = -EINVAL;
+			goto out;
+		}
+
+		table->count++;
+	}
+
+	/* the first entry of a MAC wins as before, so keep the order for equal keys */
+	for (int i = 1; i < table->count; i++) {
+		for (int j = i; (j > 0)
+		     && (quirks_override_cmp(&table->overrides[j - 1], &table->overrides[j]) > 0);
+		     j--)
+			swap(table->overrides[j - 1], table->overrides[j]);
+	}
+
+	/* parameter writes are serialized by the kernel */
+	old = rcu_dereference_protected(quirks_param, 1);
+	rcu_assign_pointer(quirks_param, table);
+	table = old;
+
+	/* cached quirks may depend on the old value */
+	xpadneo_cache_invalidate();
+
+out:
+	if (table)
+		kfree_rcu(table, rcu);
+	kfree(buf);
+	return ret;
+}
+
+static int quirks_param_get(char *buffer, const struct kernel_param *kp)
+{
+	const struct quirks_param *table;
+	int len = 0;
+
+	rcu_read_lock();
+	table = rcu_dereference(quirks_param);
+	for (int i = 0; table && (i < table->count); i++) {
+		const struct quirks_override *override = &table->overrides[i];
+
+		len += scnprintf(buffer + len, PAGE_SIZE - len, "%s%pM%c0x%x", i ? "," : "",
+				 override->mac, override->modifier, override->flags);
+	}
+	rcu_read_unlock();
+
+	return len + scnprintf(buffer + len, PAGE_SIZE - len, "\n");
+}
+
+static void quirks_param_free(void *arg)
+{
+	kfree(rcu_dereference_protected(quirks_param, 1));
+	RCU_INIT_POINTER(quirks_param, NULL);
+}
+
+static const struct kernel_param_ops quirks_param_ops = {
+	.set = quirks_param_set,
+	.get = quirks_param_get,
+	.free = quirks_param_free,
+};
+
+module_param_cb(quirks, &quirks_param_ops, NULL, 0644);
 MODULE_PARM_DESC(quirks,
 		 "(string) Override or change device quirks, specify as: \"MAC1{:,+,-}quirks1[,...16]\""
 		 ", MAC format = 11:22:33:44:55:66"
@@ -27,96 +189,297 @@ MODULE_PARM_DESC(quirks,
 		 ", swapped motor masking = " __stringify(XPADNEO_QUIRK_SWAPPED_MASK)
 		 ", apply no heuristics = " __stringify(XPADNEO_QUIRK_NO_HEURISTICS));
 
-#define DEVICE_NAME_QUIRK(n, f) \
-	{ .name_match = (n), .name_len = sizeof(n) - 1, .flags = (f) }
-#define DEVICE_OUI_QUIRK(o, f) \
-	{ .oui_match = (o), .flags = (f) }
+static void quirks_db_free(struct quirks_db *db)
+{
+	if (db) {
+		kfree(db->text);
+		kfree(db);
+	}
+}
 
-struct quirk {
-	char *name_match;
-	char *oui_match;
-	u16 name_len;
-	u32 flags;
+static int quirks_db_param_set(const char *val, const struct kernel_param *kp)
+{
+	char buf[sizeof(param_quirks_db)];
+
+	if (strscpy(buf, val, sizeof(buf)) < 0)
+		return -EINVAL;
+
+	/* the database is (re)loaded by the next probe */
+	scoped_guard(mutex, &quirks_db_lock) {
+		strscpy(param_quirks_db, strim(buf), sizeof(param_quirks_db));
+		quirks_db_loaded = false;
+	}
+
+	return 0;
+}
+
+static int quirks_db_param_get(char *buffer, const struct kernel_param *kp)
+{
+	guard(mutex)(&quirks_db_lock);
+	return scnprintf(buffer, PAGE_SIZE, "%s\n", param_quirks_db);
+}
+
+static void quirks_db_param_free(void *arg)
+{
+	quirks_db_free(rcu_dereference_protected(quirks_db, 1));
+	RCU_INIT_POINTER(quirks_db, NULL);
+}
+
+static const struct kernel_param_ops quirks_db_param_ops = {
+	.set = quirks_db_param_set,
+	.get = quirks_db_param_get,
+	.free = quirks_db_param_free,
 };
 
+module_param_cb(quirks_db, &quirks_db_param_ops, NULL, 0644);
+MODULE_PARM_DESC(quirks_db,
+		 "(string) Quirks database in the firmware directory, loaded on the next connect. "
+		 "Empty to disable.");
+
+#define QUIRKS_OUI(o, f) \
+	{ .kind = QUIRKS_KIND_OUI, .key = (o), .flags = (f) }
+
 /* MAC OUI masks */
 #define XPADNEO_OUI_MASK_LAA_MULTICAST (XPADNEO_OUI_IS_MULTICAST | XPADNEO_OUI_IS_LAA)
 
-static const struct quirk quirks[] = {
-	DEVICE_OUI_QUIRK("98:B6:EA",
-			 XPADNEO_QUIRK_NO_PULSE | XPADNEO_QUIRK_NO_TRIGGER_RUMBLE |
-			 XPADNEO_QUIRK_REVERSE_MASK),
-	DEVICE_OUI_QUIRK("98:B6:EC",
-			 XPADNEO_QUIRK_SIMPLE_CLONE | XPADNEO_QUIRK_SWAPPED_MASK),
-	DEVICE_OUI_QUIRK("A0:5A:5D", XPADNEO_QUIRK_NO_HAPTICS),
-	DEVICE_OUI_QUIRK("E4:17:D8", XPADNEO_QUIRK_SIMPLE_CLONE),
+/* built-in quirks, keep sorted by OUI */
+static const struct quirks_entry quirks[] = {
+	QUIRKS_OUI(0x98B6EA,
+		   XPADNEO_QUIRK_NO_PULSE | XPADNEO_QUIRK_NO_TRIGGER_RUMBLE |
+		   XPADNEO_QUIRK_REVERSE_MASK),
+	QUIRKS_OUI(0x98B6EC,
+		   XPADNEO_QUIRK_SIMPLE_CLONE | XPADNEO_QUIRK_SWAPPED_MASK),
+	QUIRKS_OUI(0xA05A5D, XPADNEO_QUIRK_NO_HAPTICS),
+	QUIRKS_OUI(0xE417D8, XPADNEO_QUIRK_SIMPLE_CLONE),
 };
 
-int xpadneo_quirks_init(struct xpadneo_devdata *xdata)
+static int quirks_entry_cmp(const void *a, const void *b)
 {
-	struct hid_device *hdev = xdata->hdev;
-	struct input_dev *gamepad = xdata->gamepad.idev;
-	u32 quirks_set = 0, quirks_unset = 0, quirks_override = U32_MAX;
-	u8 oui_byte = 0;
-	char oui[3] = { };
+	const struct quirks_entry *x = a, *y = b;
+
+	if (x->kind != y->kind)
+		return x->kind < y->kind ? -1 : 1;
+
+	if (x->kind == QUIRKS_KIND_NAME)
+		return strcmp(x->name, y->name);
+
+	return (x->key > y->key) - (x->key < y->key);
+}
+
+static u32 quirks_lookup(const struct quirks_entry *entries, unsigned int count,
+			 enum quirks_kind kind, u32 key, const char *name)
+{
+	const struct quirks_entry needle = { .kind = kind, .key = key, .name = name };
+	const struct quirks_entry *found;
+
+	found = bsearch(&needle, entries, count, sizeof(*entries), quirks_entry_cmp);
+	return found ? found->flags : 0;
+}
 
-	for (int i = 0; i < ARRAY_SIZE(quirks); i++) {
-		const struct quirk *q = &quirks[i];
+/*
+ * One entry per line, "#" starts a comment:
+ *
+ *   oui <flags> 98:B6:EA
+ *   crc <flags> 0x534B
+ *   name <flags> Full Device Name
+ */
+static int quirks_db_parse_line(char *line, struct quirks_entry *entry)
+{
+	char *kind, *flags;
+	u8 oui[3];
 
-		if (q->name_match && gamepad->name
-		    && (strncmp(q->name_match, gamepad->name, q->name_len) == 0))
-			xdata->quirks |= q->flags;
+	kind = strsep(&line, " \t");
+	if (!line)
+		return -EINVAL;
 
-		if (q->oui_match && gamepad->uniq
-		    && (strncasecmp(q->oui_match, gamepad->uniq, 8) == 0))
-			xdata->quirks |= q->flags;
+	line = skip_spaces(line);
+	flags = strsep(&line, " \t");
+	if (!line || kstrtou32(flags, 0, &entry->flags))
+		return -EINVAL;
+
+	line = strim(line);
+	if (!strcmp(kind, "oui")) {
+		if ((strlen(line) != 8) || (sscanf(line, "%2hhx:%2hhx:%2hhx", &oui[0], &oui[1],
+						   &oui[2]) != 3))
+			return -EINVAL;
+		entry->kind = QUIRKS_KIND_OUI;
+		entry->key = (oui[0] << 16) | (oui[1] << 8) | oui[2];
+	} else if (!strcmp(kind, "crc")) {
+		entry->kind = QUIRKS_KIND_CRC;
+		if (kstrtou32(line, 0, &entry->key) || (entry->key > U16_MAX))
+			return -EINVAL;
+	} else if (!strcmp(kind, "name") && *line) {
+		entry->kind = QUIRKS_KIND_NAME;
+		entry->name = line;
+	} else {
+		return -EINVAL;
 	}
 
-	kernel_param_lock(THIS_MODULE);
-	for (int i = 0; gamepad->uniq && (i < param_quirks.nargs); i++) {
-		const char *arg = param_quirks.args[i];
-		size_t uniq_len = strnlen(gamepad->uniq, 18);
-		size_t arg_len = strnlen(arg, 128);
+	return 0;
+}
 
-		/* check if the argument is long enough to fetch uniq + a suffix */
-		if (arg_len <= uniq_len) {
-			hid_warn(hdev,
-				 "quirks parameter '%s' ignored: invalid MAC or missing modifier\n",
-				 arg);
-			continue;
-		}
+static struct quirks_db *quirks_db_parse(const struct firmware *fw)
+{
+	struct quirks_db *db;
+	unsigned int lines = 1, line_no = 0, count = 0;
+	char *text, *p, *line;
+
+	if (fw->size > QUIRKS_DB_MAX_SIZE)
+		return ERR_PTR(-EFBIG);
+
+	text = kmemdup_nul(fw->data, fw->size, GFP_KERNEL);
+	if (!text)
+		return ERR_PTR(-ENOMEM);
+
+	for (p = text; *p; p++)
+		lines += (*p == '\n');
+
+	db = kzalloc(struct_size(db, entries, lines), GFP_KERNEL);
+	if (!db) {
+		kfree(text);
+		return ERR_PTR(-ENOMEM);
+	}
+	db->text = text;
+
+	p = text;
+	while ((line = strsep(&p, "\n")) != NULL) {
+		char *comment = strchr(line, '#');
+
+		line_no++;
+		if (comment)
+			*comment = '\0';
 
-		if (strncasecmp(gamepad->uniq, param_quirks.args[i], uniq_len) != 0)
+		line = strim(line);
+		if (!*line)
 			continue;
 
-		if ((arg[uniq_len] != ':') && (arg[uniq_len] != '+') && (arg[uniq_len] != '-')) {
-			hid_warn(hdev,
-				 "quirks parameter '%s' ignored: invalid modifier '%c'\n",
-				 arg, arg[uniq_len]);
+		if (quirks_db_parse_line(line, &db->entries[count])) {
+			pr_warn("hid-xpadneo quirks database: line %u ignored\n", line_no);
 			continue;
 		}
+		count++;
+	}
+
+	sort(db->entries, count, sizeof(db->entries[0]), quirks_entry_cmp, NULL);
+
+	/* merge duplicate keys so a lookup finds all their flags */
+	for (int i = 0; i < count; i++) {
+		if (db->count && !quirks_entry_cmp(&db->entries[db->count - 1], &db->entries[i]))
+			db->entries[db->count - 1].flags |= db->entries[i].flags;
+		else
+			db->entries[db->count++] = db->entries[i];
+	}
+
+	return db;
+}
+
+static void quirks_db_load(struct xpadneo_devdata *xdata)
+{
+	struct hid_device *hdev = xdata->hdev;
+	const struct firmware *fw;
+	struct quirks_db *db = NULL, *old;
+	int ret;
 
-		do {
-			const char *quirks_arg = arg + uniq_len + 1;
-			u32 quirks = 0;
-			int ret = kstrtou32(quirks_arg, 0, &quirks);
+	guard(mutex)(&quirks_db_lock);
+	if (quirks_db_loaded)
+		return;
+
+	quirks_db_loaded = true;
+
+	/* a missing database is fine, do not fall back to the user mode helper */
+	if (param_quirks_db[0] && !request_firmware_direct(&fw, param_quirks_db, &hdev->dev)) {
+		db = quirks_db_parse(fw);
+		release_firmware(fw);
+
+		if (IS_ERR(db)) {
+			ret = PTR_ERR(db);
+			hid_err(hdev, "failed to load quirks database %s: %d\n", param_quirks_db, ret);
+			db = NULL;
+		} else {
+			hid_info(hdev, "loaded %u entries from quirks database %s\n", db->count,
+				 param_quirks_db);
+		}
+	}
+
+	old = rcu_dereference_protected(quirks_db, lockdep_is_held(&quirks_db_lock));
+	rcu_assign_pointer(quirks_db, db);
+	if (old) {
+		synchronize_rcu();
+		quirks_db_free(old);
+	}
+
+	/* cached quirks may depend on the old database */
+	xpadneo_cache_invalidate();
+}
 
-			if (ret) {
-				hid_err(hdev, "quirks override invalid: %s\n", quirks_arg);
-				kernel_param_unlock(THIS_MODULE);
-				return -EINVAL;
-			} else if (arg[uniq_len] == ':') {
-				quirks_override = quirks;
-			} else if (arg[uniq_len] == '-') {
-				quirks_unset = quirks;
-			} else {
-				quirks_set = quirks;
-			}
-		} while (0);
+int xpadneo_quirks_init(struct xpadneo_devdata *xdata)
+{
+	struct hid_device *hdev = xdata->hdev;
+	struct input_dev *gamepad = xdata->gamepad.idev;
+	u32 quirks_set = 0, quirks_unset = 0, quirks_override = U32_MAX;
+	u32 detected = xdata->quirks, cached, oui = 0, db_flags = 0;
+	const struct quirks_param *table;
+	const struct quirks_db *db;
+	u8 mac[ETH_ALEN];
+	bool mac_valid;
+
+	/* a changed database must be loaded before the cache is trusted */
+	quirks_db_load(xdata);
+
+	/* a known controller with an unchanged descriptor skips all of the below */
+	if (xpadneo_cache_get_quirks(xdata, detected, &cached)) {
+		xdata->quirks = cached;
+		if (xdata->quirks > 0)
+			hid_info(hdev, "controller quirks: 0x%08x (cached)\n", xdata->quirks);
+		return 0;
+	}
+
+	mac_valid = gamepad->uniq && mac_pton(gamepad->uniq, mac);
+	if (mac_valid) {
+		oui = (mac[0] << 16) | (mac[1] << 8) | mac[2];
+		xdata->quirks |= quirks_lookup(quirks, ARRAY_SIZE(quirks), QUIRKS_KIND_OUI, oui,
+					       NULL);
+	}
+
+	rcu_read_lock();
+	db = rcu_dereference(quirks_db);
+	if (db) {
+		if (mac_valid)
+			db_flags |= quirks_lookup(db->entries, db->count, QUIRKS_KIND_OUI, oui, NULL);
+		db_flags |= quirks_lookup(db->entries, db->count, QUIRKS_KIND_CRC,
+					  xdata->original_crc16, NULL);
+		if (gamepad->name)
+			db_flags |= quirks_lookup(db->entries, db->count, QUIRKS_KIND_NAME, 0,
+						  gamepad->name);
+	}
+
+	table = rcu_dereference(quirks_param);
+	if (mac_valid && table) {
+		struct quirks_override needle = { };
+		const struct quirks_override *override;
+
+		memcpy(needle.mac, mac, ETH_ALEN);
+		override = bsearch(&needle, table->overrides, table->count,
+				   sizeof(table->overrides[0]), quirks_override_cmp);
+
+		/* the first entry of a MAC wins */
+		while (override && (override > table->overrides)
+		       && !quirks_override_cmp(override - 1, &needle))
+			override--;
+
+		if (override && (override->modifier == ':'))
+			quirks_override = override->flags;
+		else if (override && (override->modifier == '-'))
+			quirks_unset = override->flags;
+		else if (override)
+			quirks_set = override->flags;
+	}
+	rcu_read_unlock();
 
-		break;
+	if (db_flags > 0) {
+		hid_info(hdev, "quirks database: flags 0x%08X\n", db_flags);
+		xdata->quirks |= db_flags;
 	}
-	kernel_param_unlock(THIS_MODULE);
 
 	/* handle quirk flags which override a behavior before heuristics */
 	if (quirks_override != U32_MAX) {
@@ -130,23 +493,16 @@ int xpadneo_quirks_init(struct xpadneo_devdata *xdata)
 		xdata->quirks |= quirks_set;
 	}
 
-	/*
-	 * Check whether we should enable heuristics checks at all, and then
-	 * copy the first two characters from the uniq ID (MAC address) and
-	 * expect it being too big to copy, then `kstrtou8()` converts the
-	 * uniq ID "aa:bb:cc:dd:ee:ff" to u8, so we get the first OUI byte.
-	 */
+	/* check whether we should enable heuristics checks at all */
 	if (((xdata->quirks & XPADNEO_QUIRK_NO_HEURISTICS) == 0)
-	    && ((xdata->quirks & XPADNEO_QUIRK_SIMPLE_CLONE) == 0)
-	    && (strscpy(oui, gamepad->uniq, sizeof(oui)) == -E2BIG)
-	    && (kstrtou8(oui, 16, &oui_byte) == 0)) {
+	    && ((xdata->quirks & XPADNEO_QUIRK_SIMPLE_CLONE) == 0) && mac_valid) {
 		/*
 		 * All known GameSir devices at least one of the LAA or
 		 * multicast bits set, and a descriptor length of 283 or 306
 		 * bytes.
 		 */
 		if (((xdata->original_rsize == 283) || (xdata->original_rsize == 306))
-		    && ((oui_byte & XPADNEO_OUI_MASK_LAA_MULTICAST) > 0)) {
+		    && ((mac[0] & XPADNEO_OUI_MASK_LAA_MULTICAST) > 0)) {
 			hid_info(hdev, "enabling heuristic GameSir quirks\n");
 			xdata->quirks |= XPADNEO_QUIRK_SIMPLE_CLONE;
 		}
@@ -167,6 +523,7 @@ int xpadneo_quirks_init(struct xpadneo_devdata *xdata)
 	if (xdata->quirks > 0)
 		hid_info(hdev, "controller quirks: 0x%08x\n", xdata->quirks);
 
+	xpadneo_cache_put_quirks(xdata, detected);
 	return 0;
 }
 
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo per-profile button maps
+ *
+ * Button maps are compiled into byte-wise lookup tables when they are
+ * configured, so the raw report path permutes the button bits of the current
+ * profile with two table lookups before hid-core sees the report.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "xpadneo.h"
+
+/* button bits in report 0x01 in the order of the button usages */
+static const char *const remap_names[XPADNEO_REMAP_BUTTONS] = {
+	"a", "b", "x", "y", "lb", "rb", "back", "menu", "ls", "rs",
+};
+
+/* index of a button by its name, in the order of the button bits */
+int xpadneo_remap_button(const char *name)
+{
+	for (int i = 0; i < ARRAY_SIZE(remap_names); i++)
+		if (strcasecmp(name, remap_names[i]) == 0)
+			return i;
+
+	return -EINVAL;
+}
+
+/* parse "<profile>:<from>=<to>[,<from>=<to> ...]" */
+static int remap_parse_profile(char *s, u8 map[][XPADNEO_REMAP_BUTTONS])
+{
+	char *pairs = strchr(s, ':'), *pair, *to;
+	int from_bit, to_bit;
+	u8 profile;
+
+	if (!pairs)
+		return -EINVAL;
+	*pairs++ = '\0';
+
+	if (kstrtou8(s, 10, &profile) || (profile >= XPADNEO_XBE2_PROFILES_MAX))
+		return -EINVAL;
+
+	while ((pair = strsep(&pairs, ","))) {
+		to = strchr(pair, '=');
+		if (!to)
+			return -EINVAL;
+		*to++ = '\0';
+
+		from_bit = xpadneo_remap_button(pair);
+		to_bit = xpadneo_remap_button(to);
+		if ((from_bit < 0) || (to_bit < 0))
+			return -EINVAL;
+
+		map[profile][from_bit] = to_bit;
+	}
+
+	return 0;
+}
+
+static void remap_compile_table(const u8 *map, u16 lut[2][256])
+{
+	for (int byte = 0; byte < 2; byte++) {
+		for (int value = 0; value < 256; value++) {
+			u16 bits = 0;
+
+			for (int i = 0; i < 8; i++) {
+				int bit = byte * 8 + i;
+
+				if (!(value & BIT(i)))
+					continue;
+
+				/* the Xbox button and everything after it stays in place */
+				bits |= BIT(bit < XPADNEO_REMAP_BUTTONS ? map[bit] : bit);
+			}
+
+			lut[byte][value] = bits;
+		}
+	}
+}
+
+/*
+ * xpadneo_remap_compile - compile per-profile button maps into lookup tables
+ * @spec:  "<profile>:<from>=<to>[,<from>=<to> ...] ..." with profile 0 to 3
+ *         and buttons a, b, x, y, lb, rb, back, menu, ls, rs
+ * @remap: receives the tables, or NULL to only validate the spec
+ *
+ * Buttons not mentioned keep their function, several buttons may map to the
+ * same button. Returns 0, or -EINVAL if the spec is invalid.
+ */
+int xpadneo_remap_compile(const char *spec, struct xpadneo_remap *remap)
+{
+	u8 map[XPADNEO_XBE2_PROFILES_MAX][XPADNEO_REMAP_BUTTONS];
+	char *buf, *args, *arg;
+	int ret = 0;
+
+	if (strnlen(spec, XPADNEO_REMAP_SPEC_LEN) >= XPADNEO_REMAP_SPEC_LEN)
+		return -EINVAL;
+
+	buf = kstrdup(spec, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (int p = 0; p < XPADNEO_XBE2_PROFILES_MAX; p++)
+		for (int i = 0; i < XPADNEO_REMAP_BUTTONS; i++)
+			map[p][i] = i;
+
+	args = strim(buf);
+	while (!ret && (arg = strsep(&args, " \t"))) {
+		if (*arg)
+			ret = remap_parse_profile(arg, map);
+	}
+
+	kfree(buf);
+	if (ret || !remap)
+		return ret;
+
+	remap->active = 0;
+	for (int p = 0; p < XPADNEO_XBE2_PROFILES_MAX; p++) {
+		for (int i = 0; i < XPADNEO_REMAP_BUTTONS; i++) {
+			if (map[p][i] != i) {
+				remap->active |= BIT(p);
+				break;
+			}
+		}
+
+		if (remap->active & BIT(p))
+			remap_compile_table(map[p], remap->lut[p]);
+	}
+
+	return 0;
+}
@@ -15,20 +15,8 @@
 #include "xpadneo.h"
 #include "helpers.h"
 
-/* module parameter "trigger_rumble_mode" */
-#define PARAM_TRIGGER_RUMBLE_PRESSURE 0
-#define PARAM_TRIGGER_RUMBLE_RESERVED 1
-#define PARAM_TRIGGER_RUMBLE_DISABLE  2
-
-static u8 param_trigger_rumble_mode;
-module_param_named(trigger_rumble_mode, param_trigger_rumble_mode, byte, 0644);
-MODULE_PARM_DESC(trigger_rumble_mode, "(u8) Trigger rumble mode. 0: pressure, 2: disable.");
-
-static u8 param_rumble_attenuation[2];
-module_param_array_named(rumble_attenuation, param_rumble_attenuation, byte, NULL, 0644);
-MODULE_PARM_DESC(rumble_attenuation,
-		 "(u8) Attenuate the rumble strength: all[,triggers] "
-		 "0 (none, full rumble) to 100 (max, no rumble).");
+/* always include last */
+#include "compat.h"
 
 static bool param_ff_connect_notify = 1;
 module_param_named(ff_connect_notify, param_ff_connect_notify, bool, 0644);
@@ -41,6 +29,12 @@ MODULE_PARM_DESC(force_disable_hogp,
 		 "(bool) Forcefully disables the HOGP rumble path for testing. 1: disable, 0: enable.");
 static struct workqueue_struct *rumble_wq;
 
+/* duration of a trigger click pulse */
+#define XPADNEO_RUMBLE_CLICK_10MS 2
+
+/* time after which changes within the dead band are sent */
+#define XPADNEO_RUMBLE_SETTLE_MS 50
+
 inline void xpadneo_rumble_streaming_set(struct xpadneo_devdata *xdata, const bool enabled)
 {
 	if (likely(cmpxchg(&xdata->rumble.enabled, !enabled, enabled) == !enabled))
@@ -50,7 +44,121 @@ inline void xpadneo_rumble_streaming_set(struct xpadneo_devdata *xdata, const bo
 inline bool xpadneo_rumble_streaming_get(const struct xpadneo_devdata *xdata)
 {
 	/* get globally visible state if rumble streaming is enabled */
-	return smp_load_acquire(&xdata->rumble.enabled);
+	return smp_load_acquire(&xdata->rumble.enabled) && !READ_ONCE(xdata->shutdown);
+}
+
+/* apply the motor mask quirks of the controller firmware */
+static enum xpadneo_rumble_motors rumble_motor_mask(const struct xpadneo_devdata *xdata,
+						    enum xpadneo_rumble_motors enable)
+{
+	/* set all bits if not supported (some clones require these set) */
+	if (unlikely(xdata->quirks & XPADNEO_QUIRK_NO_MOTOR_MASK))
+		enable = XBOX_RUMBLE_ALL;
+
+	/* reverse the bits for trigger and main motors */
+	if (unlikely(xdata->quirks & XPADNEO_QUIRK_REVERSE_MASK))
+		enable = SWAP_BITS(SWAP_BITS(enable, 1, 2), 0, 3);
+
+	/* swap the bits of trigger and main motors */
+	if (unlikely(xdata->quirks & XPADNEO_QUIRK_SWAPPED_MASK))
+		enable = SWAP_BITS(SWAP_BITS(enable, 0, 2), 1, 3);
+
+	return enable;
+}
+
+/* called with the rumble lock held */
+static bool rumble_idle(const struct xpadneo_devdata *xdata)
+{
+	/* no effect, stream or motor the firmware may still be running */
+	return !xdata->rumble.stream_len
+	    && !memchr_inv(&xdata->rumble.data, 0, sizeof(xdata->rumble.data))
+	    && !memchr_inv(&xdata->rumble.shadow, 0, sizeof(xdata->rumble.shadow));
+}
+
+/* play a single short pulse on idle trigger motors, called from the worker only */
+static void rumble_click(struct xpadneo_devdata *xdata, struct xpadneo_rumble_report *r,
+			 enum xpadneo_rumble_motors click, u8 magnitude)
+{
+	bool hogp = xdata->uses_hogp && !param_force_disable_hogp;
+	int ret;
+
+	memset(r, 0, sizeof(*r));
+	r->report_id = XPADNEO_XBOX_RUMBLE_REPORT;
+	r->data.enable = rumble_motor_mask(xdata, click);
+
+	if (click & XBOX_RUMBLE_LEFT)
+		r->data.magnitude_left = magnitude;
+	if (click & XBOX_RUMBLE_RIGHT)
+		r->data.magnitude_right = magnitude;
+
+	/* the firmware stops the motor after the sustain time, and plays it once */
+	if (likely((xdata->quirks & XPADNEO_QUIRK_NO_PULSE) == 0))
+		r->data.pulse_sustain_10ms = XPADNEO_RUMBLE_CLICK_10MS;
+
+	ret = xpadneo_device_output_report(xdata->hdev, (__u8 *) r, sizeof(*r), hogp);
+	if ((ret < 0) || likely((xdata->quirks & XPADNEO_QUIRK_NO_PULSE) == 0))
+		goto out;
+
+	/* no timing support in the firmware, so stop the motor manually */
+	msleep(XPADNEO_RUMBLE_CLICK_10MS * 10);
+	r->data.magnitude_left = 0;
+	r->data.magnitude_right = 0;
+	ret = xpadneo_device_output_report(xdata->hdev, (__u8 *) r, sizeof(*r), hogp);
+
+out:
+	if (ret < 0)
+		hid_warn(xdata->hdev, "failed to send click pulse: %d\n", ret);
+}
+
+/* called with the rumble lock held, fills in the magnitude to send for one motor */
+static enum xpadneo_rumble_motors rumble_update_motor(u8 *out, u8 shadow, u8 target, u8 deadband,
+						      enum xpadneo_rumble_motors motor,
+						      bool *deferred)
+{
+	/* starting and stopping a motor is never deferred */
+	if ((target == shadow) || (target && shadow && (abs(target - shadow) < deadband))) {
+		*deferred |= target != shadow;
+		*out = shadow;
+		return XBOX_RUMBLE_NONE;
+	}
+
+	*out = target;
+	return motor;
+}
+
+/*
+ * called with the rumble lock held, charges one report to the budget of the
+ * device or returns false and the time when the budget allows the next report
+ */
+static bool rumble_charge_budget(struct xpadneo_devdata *xdata, ktime_t interval, ktime_t *when)
+{
+	ktime_t now = ktime_get(), tolerance, allowed;
+
+	if (!interval)
+		return true;
+
+	/* virtual scheduling: a token bucket of XPADNEO_RUMBLE_REPORT_BURST reports */
+	tolerance = interval * (XPADNEO_RUMBLE_REPORT_BURST - 1);
+	allowed = ktime_sub(xdata->rumble.budget_tat, tolerance);
+	if (ktime_before(now, allowed)) {
+		*when = allowed;
+		return false;
+	}
+
+	xdata->rumble.budget_tat = ktime_add(max(xdata->rumble.budget_tat, now), interval);
+	return true;
+}
+
+/* wake the worker at the given time, it then sends the exact magnitudes */
+static void rumble_defer(struct xpadneo_devdata *xdata, ktime_t when)
+{
+	struct hrtimer *t = &xdata->rumble.defer_timer;
+
+	/* an earlier wakeup settles the motors as well */
+	if (hrtimer_active(t) && !ktime_after(hrtimer_get_expires(t), when))
+		return;
+
+	hrtimer_start(t, when, HRTIMER_MODE_ABS_SOFT);
 }
 
 static void rumble_worker(struct work_struct *work)
@@ -58,8 +166,37 @@ static void rumble_worker(struct work_struct *work)
 	struct xpadneo_devdata *xdata = container_of(work, struct xpadneo_devdata, rumble.worker);
 	struct hid_device *hdev = xdata->hdev;
 	struct xpadneo_rumble_report *r = xdata->rumble.output_report_dmabuf;
+	const struct xpadneo_config *config;
+	enum xpadneo_rumble_motors click, enable;
+	u8 click_magnitude, deadband;
+	ktime_t interval, when;
+	bool deferred;
 	int ret;
 
+reschedule:
+	rcu_read_lock();
+	config = rcu_dereference(xdata->config);
+	deadband = config->rumble_deadband;
+	interval = config->rumble_interval;
+	rcu_read_unlock();
+
+	scoped_guard(spinlock_irqsave, &xdata->rumble.lock) {
+		click = xdata->rumble.click;
+		click_magnitude = xdata->rumble.click_magnitude;
+		xdata->rumble.click = XBOX_RUMBLE_NONE;
+
+		/* an effect started meanwhile takes precedence over the click */
+		if (!xpadneo_rumble_streaming_get(xdata) || !rumble_idle(xdata))
+			click = XBOX_RUMBLE_NONE;
+
+		/* a late click is useless, so drop it instead of waiting for the budget */
+		if ((click != XBOX_RUMBLE_NONE) && !rumble_charge_budget(xdata, interval, &when))
+			click = XBOX_RUMBLE_NONE;
+	}
+
+	if (unlikely(click != XBOX_RUMBLE_NONE))
+		rumble_click(xdata, r, click, click_magnitude);
+
 	memset(r, 0, sizeof(*r));
 	r->report_id = XPADNEO_XBOX_RUMBLE_REPORT;
 
@@ -77,55 +214,61 @@ static void rumble_worker(struct work_struct *work)
 		r->data.loop_count = 0xEB;
 	}
 
-reschedule:
-	r->data.enable = XBOX_RUMBLE_ALL;
-
 	scoped_guard(spinlock_irqsave, &xdata->rumble.lock) {
+		struct xpadneo_rumble_data *data = &xdata->rumble.data, *shadow = &xdata->rumble.shadow;
+
 		/* only proceed once initialization data is globally visible */
 		if (unlikely(!xpadneo_rumble_streaming_get(xdata)))
 			goto check_pending;
 
-		if (unlikely(xdata->quirks & XPADNEO_QUIRK_NO_TRIGGER_RUMBLE)) {
-			/* do not send these bits if not supported */
-			r->data.enable &= ~XBOX_RUMBLE_TRIGGERS;
-		} else {
-			/* trigger motors */
-			r->data.magnitude_left = xdata->rumble.data.magnitude_left;
-			r->data.magnitude_right = xdata->rumble.data.magnitude_right;
+		/* the deferred wakeup sends the exact magnitudes */
+		if (xdata->rumble.settle) {
+			xdata->rumble.settle = false;
+			deadband = 0;
 		}
 
-		/* main motors */
-		r->data.magnitude_strong = xdata->rumble.data.magnitude_strong;
-		r->data.magnitude_weak = xdata->rumble.data.magnitude_weak;
+		/* do not reprogram motors that have not changed, or not by much */
+		deferred = false;
+		enable = rumble_update_motor(&r->data.magnitude_strong, shadow->magnitude_strong,
+					     data->magnitude_strong, deadband, XBOX_RUMBLE_STRONG,
+					     &deferred);
+		enable |= rumble_update_motor(&r->data.magnitude_weak, shadow->magnitude_weak,
+					      data->magnitude_weak, deadband, XBOX_RUMBLE_WEAK,
+					      &deferred);
+
+		/* do not send trigger motor bits if not supported */
+		if (likely((xdata->quirks & XPADNEO_QUIRK_NO_TRIGGER_RUMBLE) == 0)) {
+			enable |= rumble_update_motor(&r->data.magnitude_left,
+						      shadow->magnitude_left,
+						      data->magnitude_left, deadband,
+						      XBOX_RUMBLE_LEFT, &deferred);
+			enable |= rumble_update_motor(&r->data.magnitude_right,
+						      shadow->magnitude_right,
+						      data->magnitude_right, deadband,
+						      XBOX_RUMBLE_RIGHT, &deferred);
+		}
 
-		/* do not reprogram motors that have not changed */
-		if (unlikely(xdata->rumble.shadow.magnitude_strong == r->data.magnitude_strong))
-			r->data.enable &= ~XBOX_RUMBLE_STRONG;
-		if (unlikely(xdata->rumble.shadow.magnitude_weak == r->data.magnitude_weak))
-			r->data.enable &= ~XBOX_RUMBLE_WEAK;
-		if (likely(xdata->rumble.shadow.magnitude_left == r->data.magnitude_left))
-			r->data.enable &= ~XBOX_RUMBLE_LEFT;
-		if (likely(xdata->rumble.shadow.magnitude_right == r->data.magnitude_right))
-			r->data.enable &= ~XBOX_RUMBLE_RIGHT;
+		/* small changes are sent exactly once the magnitudes have settled */
+		if (unlikely(deferred))
+			rumble_defer(xdata, ktime_add_ms(ktime_get(), XPADNEO_RUMBLE_SETTLE_MS));
 
 		/* do not send a report if nothing changed */
-		if (unlikely(r->data.enable == XBOX_RUMBLE_NONE))
+		if (unlikely(enable == XBOX_RUMBLE_NONE))
 			goto check_pending;
 
-		/* shadow our current rumble values for the next cycle */
-		memcpy(&xdata->rumble.shadow, &xdata->rumble.data, sizeof(xdata->rumble.data));
-
-		/* set all bits if not supported (some clones require these set) */
-		if (unlikely(xdata->quirks & XPADNEO_QUIRK_NO_MOTOR_MASK))
-			r->data.enable = XBOX_RUMBLE_ALL;
+		/* keep the link free for input reports, the latest magnitudes win later */
+		if (unlikely(!rumble_charge_budget(xdata, interval, &when))) {
+			rumble_defer(xdata, when);
+			goto check_pending;
+		}
 
-		/* reverse the bits for trigger and main motors */
-		if (unlikely(xdata->quirks & XPADNEO_QUIRK_REVERSE_MASK))
-			r->data.enable = SWAP_BITS(SWAP_BITS(r->data.enable, 1, 2), 0, 3);
+		/* shadow our current rumble values for the next cycle */
+		shadow->magnitude_strong = r->data.magnitude_strong;
+		shadow->magnitude_weak = r->data.magnitude_weak;
+		shadow->magnitude_left = r->data.magnitude_left;
+		shadow->magnitude_right = r->data.magnitude_right;
 
-		/* swap the bits of trigger and main motors */
-		if (unlikely(xdata->quirks & XPADNEO_QUIRK_SWAPPED_MASK))
-			r->data.enable = SWAP_BITS(SWAP_BITS(r->data.enable, 0, 2), 1, 3);
+		r->data.enable = rumble_motor_mask(xdata, enable);
 	}
 
 	ret = xpadneo_device_output_report(hdev, (__u8 *) r, sizeof(*r),
@@ -142,14 +285,27 @@ check_pending:
 	}
 }
 
-static inline u8 calculate_magnitude(s32 magnitude, int fraction)
+static inline u8 calculate_magnitude(u32 magnitude, u32 scale)
+{
+	/* scale is a Q32 factor precomputed by the device config */
+	return (u8)(((u64)magnitude * scale + BIT_ULL(31)) >> 32);
+}
+
+/* called with the rumble lock held */
+static void rumble_schedule(struct xpadneo_devdata *xdata)
 {
-	return (u8)((magnitude * fraction + S16_MAX) / U16_MAX);
+	/* schedule writing a rumble report to the controller */
+	if (!queue_work(rumble_wq, &xdata->rumble.worker)) {
+		/* the worker is still waiting on the hardware */
+		smp_store_release(&xdata->rumble.pending, true);
+		hid_notice_once(xdata->hdev, "throttled rumble reprogramming\n");
+	}
 }
 
 static int rumble_playback(struct input_dev *dev, int effect_id, int value)
 {
-	int fraction_TL, fraction_TR, fraction_MAIN, percent_TRIGGERS, percent_MAIN;
+	const struct xpadneo_config *config;
+	u32 scale_main, scale_triggers;
 	s32 weak, strong, max_main;
 
 	struct hid_device *hdev = input_get_drvdata(dev);
@@ -157,7 +313,7 @@ static int rumble_playback(struct input_dev *dev, int effect_id, int value)
 	struct ff_effect *effect = &xdata->gamepad.idev->ff->effects[effect_id];
 
 	/* do not let FF clients run before rumble state is ready */
-	if (unlikely(!smp_load_acquire(&xdata->rumble.enabled)))
+	if (unlikely(!xpadneo_rumble_streaming_get(xdata)))
 		return 0;
 
 	if (unlikely(effect->type != FF_RUMBLE)) {
@@ -178,27 +334,12 @@ static int rumble_playback(struct input_dev *dev, int effect_id, int value)
 		strong = effect->u.rumble.strong_magnitude;
 	}
 
-	/* calculate the rumble attenuation */
-	percent_MAIN = 100 - param_rumble_attenuation[0];
-	percent_MAIN = clamp(percent_MAIN, 0, 100);
-
-	percent_TRIGGERS = 100 - param_rumble_attenuation[1];
-	percent_TRIGGERS = clamp(percent_TRIGGERS, 0, 100);
-	percent_TRIGGERS = percent_TRIGGERS * percent_MAIN / 100;
-
-	switch (param_trigger_rumble_mode) {
-	case PARAM_TRIGGER_RUMBLE_DISABLE:
-		fraction_MAIN = percent_MAIN;
-		fraction_TL = 0;
-		fraction_TR = 0;
-		break;
-	case PARAM_TRIGGER_RUMBLE_PRESSURE:
-	default:
-		fraction_MAIN = percent_MAIN;
-		fraction_TL = (xdata->last_abs_z * percent_TRIGGERS + 511) / 1023;
-		fraction_TR = (xdata->last_abs_rz * percent_TRIGGERS + 511) / 1023;
-		break;
-	}
+	/* get the precomputed rumble attenuation */
+	rcu_read_lock();
+	config = rcu_dereference(xdata->config);
+	scale_main = config->rumble_main_scale;
+	scale_triggers = config->rumble_trigger_scale;
+	rcu_read_unlock();
 
 	/*
 	 * we want to keep the rumbling at the triggers at the maximum
@@ -208,24 +349,243 @@ static int rumble_playback(struct input_dev *dev, int effect_id, int value)
 
 	scoped_guard(spinlock_irqsave, &xdata->rumble.lock) {
 		/* calculate the physical magnitudes, scale from 16 bit to 0..100 */
-		xdata->rumble.data.magnitude_strong = calculate_magnitude(strong, fraction_MAIN);
-		xdata->rumble.data.magnitude_weak = calculate_magnitude(weak, fraction_MAIN);
+		xdata->rumble.data.magnitude_strong = calculate_magnitude(strong, scale_main);
+		xdata->rumble.data.magnitude_weak = calculate_magnitude(weak, scale_main);
 
-		/* calculate the physical magnitudes, scale from 16 bit to 0..100 */
-		xdata->rumble.data.magnitude_left = calculate_magnitude(max_main, fraction_TL);
-		xdata->rumble.data.magnitude_right = calculate_magnitude(max_main, fraction_TR);
-
-		/* schedule writing a rumble report to the controller */
-		if (!queue_work(rumble_wq, &xdata->rumble.worker)) {
-			/* the worker is still waiting on the hardware */
-			smp_store_release(&xdata->rumble.pending, true);
-			hid_notice_once(hdev, "throttled rumble reprogramming\n");
-		}
+		/* calculate the physical magnitudes, scale by 16 bit and trigger pressure */
+		xdata->rumble.data.magnitude_left =
+		    calculate_magnitude(max_main * xdata->last_abs_z, scale_triggers);
+		xdata->rumble.data.magnitude_right =
+		    calculate_magnitude(max_main * xdata->last_abs_rz, scale_triggers);
+
+		rumble_schedule(xdata);
 	}
 
 	return 0;
 }
 
+/* called with the rumble lock held */
+static void rumble_stream_apply(struct xpadneo_devdata *xdata,
+				const struct xpadneo_rumble_frame *frame)
+{
+	const struct xpadneo_config *config;
+	u32 scale_main, scale_triggers;
+
+	rcu_read_lock();
+	config = rcu_dereference(xdata->config);
+	scale_main = config->rumble_main_scale;
+	scale_triggers = config->rumble_trigger_scale;
+	rcu_read_unlock();
+
+	xdata->rumble.data.magnitude_strong = calculate_magnitude(frame->strong, scale_main);
+	xdata->rumble.data.magnitude_weak = calculate_magnitude(frame->weak, scale_main);
+
+	/* stream frames set the trigger motors directly, as if at full pressure */
+	xdata->rumble.data.magnitude_left = calculate_magnitude(frame->left * 1023, scale_triggers);
+	xdata->rumble.data.magnitude_right =
+	    calculate_magnitude(frame->right * 1023, scale_triggers);
+
+	rumble_schedule(xdata);
+}
+
+/* scale a 0..100 magnitude of a foreign report like a 16 bit one at full trigger pressure */
+static inline u8 calculate_percent(u8 percent, u32 scale, u32 pressure)
+{
+	return calculate_magnitude(DIV_ROUND_CLOSEST(min_t(u32, percent, 100) * U16_MAX, 100)
+				   * pressure, scale);
+}
+
+/*
+ * xpadneo_rumble_merge - take over a rumble report written by another client
+ *
+ * Does not sleep. The magnitudes of the enabled motors replace those in the
+ * rumble slot, the latest writer wins, and the worker applies quirks, dead
+ * band and budget as for our own effects. The pulse timing of the report is
+ * not kept, clients are expected to stop effects explicitly. Returns 0, or
+ * -EAGAIN while rumble is not ready.
+ */
+int xpadneo_rumble_merge(struct xpadneo_devdata *xdata, const struct xpadneo_rumble_data *in)
+{
+	struct xpadneo_rumble_data *data = &xdata->rumble.data;
+	const struct xpadneo_config *config;
+	u32 scale_main, scale_triggers;
+
+	rcu_read_lock();
+	config = rcu_dereference(xdata->config);
+	scale_main = config->rumble_main_scale;
+	scale_triggers = config->rumble_trigger_scale;
+	rcu_read_unlock();
+
+	guard(spinlock_irqsave)(&xdata->rumble.lock);
+
+	if (unlikely(!xpadneo_rumble_streaming_get(xdata)))
+		return -EAGAIN;
+
+	if (in->enable & XBOX_RUMBLE_STRONG)
+		data->magnitude_strong = calculate_percent(in->magnitude_strong, scale_main, 1);
+	if (in->enable & XBOX_RUMBLE_WEAK)
+		data->magnitude_weak = calculate_percent(in->magnitude_weak, scale_main, 1);
+	if (in->enable & XBOX_RUMBLE_LEFT)
+		data->magnitude_left = calculate_percent(in->magnitude_left, scale_triggers, 1023);
+	if (in->enable & XBOX_RUMBLE_RIGHT)
+		data->magnitude_right = calculate_percent(in->magnitude_right, scale_triggers, 1023);
+
+	rumble_schedule(xdata);
+	return 0;
+}
+
+/*
+ * xpadneo_rumble_click - pulse a trigger motor as feedback of a click
+ * @motor:    XBOX_RUMBLE_LEFT or XBOX_RUMBLE_RIGHT
+ * @strength: percentage of the full trigger magnitude, before attenuation
+ *
+ * Does not sleep. Only plays while no effect or stream uses the motors, so a
+ * click never cuts into the rumble of a game.
+ */
+void xpadneo_rumble_click(struct xpadneo_devdata *xdata, enum xpadneo_rumble_motors motor,
+			  unsigned int strength)
+{
+	const struct xpadneo_config *config;
+	u32 scale_triggers;
+	u8 magnitude;
+
+	if (unlikely(xdata->quirks & XPADNEO_QUIRK_NO_TRIGGER_RUMBLE))
+		return;
+
+	rcu_read_lock();
+	config = rcu_dereference(xdata->config);
+	scale_triggers = config->rumble_trigger_scale;
+	rcu_read_unlock();
+
+	/* scale like stream frames at full trigger pressure */
+	strength = DIV_ROUND_CLOSEST(U16_MAX * min(strength, 100U), 100);
+	magnitude = calculate_magnitude(strength * 1023, scale_triggers);
+	if (!magnitude)
+		return;
+
+	guard(spinlock_irqsave)(&xdata->rumble.lock);
+
+	if (unlikely(!xpadneo_rumble_streaming_get(xdata)) || !rumble_idle(xdata))
+		return;
+
+	xdata->rumble.click |= motor;
+	xdata->rumble.click_magnitude = magnitude;
+	rumble_schedule(xdata);
+}
+
+static enum hrtimer_restart rumble_defer_timer(struct hrtimer *t)
+{
+	struct xpadneo_devdata *xdata = container_of(t, struct xpadneo_devdata, rumble.defer_timer);
+
+	scoped_guard(spinlock_irqsave, &xdata->rumble.lock) {
+		xdata->rumble.settle = true;
+		rumble_schedule(xdata);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/* apply all frames which are due, returns the time of the next frame or 0 */
+static u64 rumble_stream_run(struct xpadneo_devdata *xdata, u64 now)
+{
+	const struct xpadneo_rumble_frame *frame, *due = NULL;
+
+	lockdep_assert_held(&xdata->rumble.lock);
+
+	while (xdata->rumble.stream_len) {
+		frame = &xdata->rumble.stream[xdata->rumble.stream_head];
+		if (frame->timestamp_ns > now)
+			break;
+
+		/* only the latest due frame matters */
+		due = frame;
+		xdata->rumble.stream_head =
+		    (xdata->rumble.stream_head + 1) % XPADNEO_RUMBLE_STREAM_LEN;
+		xdata->rumble.stream_len--;
+	}
+
+	if (due)
+		rumble_stream_apply(xdata, due);
+
+	if (!xdata->rumble.stream_len)
+		return 0;
+
+	return xdata->rumble.stream[xdata->rumble.stream_head].timestamp_ns;
+}
+
+static enum hrtimer_restart rumble_stream_timer(struct hrtimer *t)
+{
+	struct xpadneo_devdata *xdata = container_of(t, struct xpadneo_devdata, rumble.stream_timer);
+	u64 next;
+
+	guard(spinlock_irqsave)(&xdata->rumble.lock);
+
+	/*
+	 * Re-arm while holding the lock: the writer may have started the timer
+	 * again while we waited for the lock, so we must not touch the expiry of
+	 * a possibly queued timer.
+	 */
+	next = rumble_stream_run(xdata, ktime_get_ns());
+	if (next)
+		hrtimer_start(t, ns_to_ktime(next), HRTIMER_MODE_ABS);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * xpadneo_rumble_stream - queue rumble frames written by userspace
+ *
+ * Frames bypass the FF core and go straight into the rumble slot, so the
+ * worker still paces the hardware and applies the quirks. Returns the number
+ * of frames accepted, or -EAGAIN while rumble is not ready.
+ */
+ssize_t xpadneo_rumble_stream(struct xpadneo_devdata *xdata,
+			      const struct xpadneo_rumble_frame *frames, unsigned int count)
+{
+	struct xpadneo_rumble_frame *tail;
+	unsigned int i, index;
+	u64 now = ktime_get_ns(), next;
+
+	count = min_t(unsigned int, count, XPADNEO_RUMBLE_STREAM_LEN);
+
+	guard(spinlock_irqsave)(&xdata->rumble.lock);
+
+	if (unlikely(!xpadneo_rumble_streaming_get(xdata)))
+		return -EAGAIN;
+
+	for (i = 0; i < count; i++) {
+		if (xdata->rumble.stream_len) {
+			index = (xdata->rumble.stream_head + xdata->rumble.stream_len - 1)
+			    % XPADNEO_RUMBLE_STREAM_LEN;
+			tail = &xdata->rumble.stream[index];
+
+			/* going back in time starts a new stream */
+			if (frames[i].timestamp_ns < tail->timestamp_ns)
+				xdata->rumble.stream_len = 0;
+		}
+
+		if (xdata->rumble.stream_len == XPADNEO_RUMBLE_STREAM_LEN) {
+			/* drop the oldest frame, the latest value wins */
+			xdata->rumble.stream_head =
+			    (xdata->rumble.stream_head + 1) % XPADNEO_RUMBLE_STREAM_LEN;
+			xdata->rumble.stream_len--;
+		}
+
+		index = (xdata->rumble.stream_head + xdata->rumble.stream_len)
+		    % XPADNEO_RUMBLE_STREAM_LEN;
+		xdata->rumble.stream[index] = frames[i];
+		xdata->rumble.stream_len++;
+	}
+
+	next = rumble_stream_run(xdata, now);
+	if (next)
+		hrtimer_start(&xdata->rumble.stream_timer, ns_to_ktime(next), HRTIMER_MODE_ABS);
+	else
+		hrtimer_try_to_cancel(&xdata->rumble.stream_timer);
+
+	return count;
+}
+
 static void rumble_test(char *which, const struct xpadneo_devdata *xdata,
 			struct xpadneo_rumble_report pck)
 {
@@ -303,6 +663,12 @@ static void rumble_test(char *which, const struct xpadneo_devdata *xdata,
 static void rumble_welcome(const struct xpadneo_devdata *xdata)
 {
 	struct xpadneo_rumble_report pck = { };
+	bool triggers;
+
+	/* a trigger scale of 0 disables trigger rumble by setting */
+	rcu_read_lock();
+	triggers = rcu_dereference(xdata->config)->rumble_trigger_scale != 0;
+	rcu_read_unlock();
 
 	pck.report_id = XPADNEO_XBOX_RUMBLE_REPORT;
 
@@ -332,7 +698,7 @@ static void rumble_welcome(const struct xpadneo_devdata *xdata)
 	pck.data.enable = XBOX_RUMBLE_STRONG;
 	rumble_test("strong motor", xdata, pck);
 
-	if (!(xdata->quirks & XPADNEO_QUIRK_NO_TRIGGER_RUMBLE)) {
+	if (triggers && !(xdata->quirks & XPADNEO_QUIRK_NO_TRIGGER_RUMBLE)) {
 		pck.data.enable = XBOX_RUMBLE_TRIGGERS;
 		rumble_test("trigger motors", xdata, pck);
 	}
@@ -424,15 +790,17 @@ int xpadneo_rumble_init(struct hid_device *hdev)
 	spin_lock_init(&xdata->rumble.lock);
 	INIT_WORK(&xdata->rumble.worker, rumble_worker);
 	INIT_WORK(&xdata->rumble.init_worker, rumble_welcome_worker);
+	hrtimer_setup(&xdata->rumble.stream_timer, rumble_stream_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_ABS);
+	hrtimer_setup(&xdata->rumble.defer_timer, rumble_defer_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_ABS_SOFT);
+	xdata->rumble.stream_len = 0;
 	xdata->rumble.output_report_dmabuf = devm_kzalloc(&hdev->dev,
 							  sizeof(struct xpadneo_rumble_report),
 							  GFP_KERNEL);
 	if (xdata->rumble.output_report_dmabuf == NULL)
 		return -ENOMEM;
 
-	if (param_trigger_rumble_mode == PARAM_TRIGGER_RUMBLE_DISABLE)
-		xdata->quirks |= XPADNEO_QUIRK_NO_TRIGGER_RUMBLE;
-
 	/* set capabilities */
 	input_set_capability(gamepad, EV_FF, FF_RUMBLE);
 	ret = input_ff_create(gamepad, FF_MAX_EFFECTS);
@@ -455,9 +823,6 @@ int xpadneo_rumble_init(struct hid_device *hdev)
 
 int xpadneo_rumble_init_workqueue(void)
 {
-	if (param_trigger_rumble_mode == 1)
-		pr_warn("hid-xpadneo trigger_rumble_mode=1 is unknown, defaulting to 0\n");
-
 	rumble_wq = alloc_ordered_workqueue("xpadneo/rumbled", WQ_HIGHPRI);
 	if (rumble_wq)
 		return 0;
@@ -474,8 +839,103 @@ void xpadneo_rumble_destroy_workqueue(void)
 void xpadneo_rumble_remove(struct xpadneo_devdata *xdata)
 {
 	/* disable rumble before removable to prevent queueing new data */
-	xpadneo_rumble_streaming_set(xdata, false);
+	scoped_guard(spinlock_irqsave, &xdata->rumble.lock) {
+		xpadneo_rumble_streaming_set(xdata, false);
+	}
 
+	/* the worker no longer defers with rumble disabled, but the timer queues it */
+	hrtimer_cancel(&xdata->rumble.stream_timer);
+	hrtimer_cancel(&xdata->rumble.defer_timer);
 	cancel_work_sync(&xdata->rumble.init_worker);
 	cancel_work_sync(&xdata->rumble.worker);
 }
+
+/*
+ * xpadneo_rumble_suspend - quiesce rumble before the system sleeps
+ *
+ * Drops queued stream frames, stops the motors and keeps new effects out until
+ * xpadneo_rumble_resume(). The welcome rumble is skipped if still pending.
+ */
+void xpadneo_rumble_suspend(struct xpadneo_devdata *xdata)
+{
+	struct xpadneo_rumble_report *r = xdata->rumble.output_report_dmabuf;
+	enum xpadneo_rumble_motors enable = XBOX_RUMBLE_ALL;
+	bool resume;
+	int ret;
+
+	if (!r)
+		return;
+
+	/* the welcome rumble publishes readiness when done, so stop it first */
+	resume = cancel_work_sync(&xdata->rumble.init_worker);
+
+	scoped_guard(spinlock_irqsave, &xdata->rumble.lock) {
+		resume |= smp_load_acquire(&xdata->rumble.enabled);
+		xpadneo_rumble_streaming_set(xdata, false);
+		xdata->rumble.stream_len = 0;
+		xdata->rumble.click = XBOX_RUMBLE_NONE;
+	}
+
+	hrtimer_cancel(&xdata->rumble.stream_timer);
+	hrtimer_cancel(&xdata->rumble.defer_timer);
+	cancel_work_sync(&xdata->rumble.worker);
+	smp_store_release(&xdata->rumble.pending, false);
+	xdata->rumble.settle = false;
+	xdata->rumble.resume = resume;
+
+	/* the worker is idle now, and the motors are off if we never programmed them */
+	if (!memchr_inv(&xdata->rumble.shadow, 0, sizeof(xdata->rumble.shadow)))
+		return;
+
+	memset(&xdata->rumble.data, 0, sizeof(xdata->rumble.data));
+	memset(&xdata->rumble.shadow, 0, sizeof(xdata->rumble.shadow));
+
+	/* an effect would otherwise keep pulsing the motors through the sleep */
+	if (unlikely(xdata->quirks & XPADNEO_QUIRK_NO_TRIGGER_RUMBLE))
+		enable = XBOX_RUMBLE_MAIN;
+
+	memset(r, 0, sizeof(*r));
+	r->report_id = XPADNEO_XBOX_RUMBLE_REPORT;
+	r->data.enable = rumble_motor_mask(xdata, enable);
+
+	ret = xpadneo_device_output_report(xdata->hdev, (__u8 *) r, sizeof(*r),
+					   xdata->uses_hogp && !param_force_disable_hogp);
+	if (ret < 0)
+		hid_warn(xdata->hdev, "failed to stop rumble motors: %d\n", ret);
+}
+
+/*
+ * xpadneo_rumble_shutdown - drop all rumble of a controller which powers off
+ *
+ * Must not sleep, it is called from the battery report. The caller published
+ * the shutdown before, so the worker and new effects see rumble disabled once
+ * we hold the lock.
+ */
+void xpadneo_rumble_shutdown(struct xpadneo_devdata *xdata)
+{
+	if (!xdata->rumble.output_report_dmabuf)
+		return;
+
+	scoped_guard(spinlock_irqsave, &xdata->rumble.lock) {
+		xdata->rumble.stream_len = 0;
+		xdata->rumble.click = XBOX_RUMBLE_NONE;
+
+		/* the controller starts with its motors stopped */
+		memset(&xdata->rumble.data, 0, sizeof(xdata->rumble.data));
+		memset(&xdata->rumble.shadow, 0, sizeof(xdata->rumble.shadow));
+	}
+
+	/* a running stream timer finds no frames and stops */
+	hrtimer_try_to_cancel(&xdata->rumble.stream_timer);
+	hrtimer_try_to_cancel(&xdata->rumble.defer_timer);
+}
+
+/* re-enable rumble after resume, the motors are known to be stopped */
+void xpadneo_rumble_resume(struct xpadneo_devdata *xdata)
+{
+	if (!xdata->rumble.output_report_dmabuf || !xdata->rumble.resume)
+		return;
+
+	xdata->rumble.resume = false;
+	xpadneo_rumble_streaming_set(xdata, true);
+}
@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo hot-standby across short disconnects
+ *
+ * When a controller drops the link, the synthetic input devices, the device
+ * id and the per-device settings are parked for a grace period, keyed by the
+ * controller MAC. A reconnect within that period adopts them again, so the
+ * event nodes of those devices stay the same and no new devices show up.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "xpadneo.h"
+
+static unsigned int param_standby_timeout;
+module_param_named(standby_timeout, param_standby_timeout, uint, 0644);
+MODULE_PARM_DESC(standby_timeout,
+		 "(uint) Keep the devices of a disconnected controller for this many seconds, "
+		 "so a quick reconnect reuses them. 0: disabled.");
+
+struct xpadneo_standby {
+	struct list_head node;
+	struct delayed_work expire;
+	char uniq[64];
+	int id;
+	struct input_dev *idev[XPADNEO_SYNTHETIC_MOUSE + 1];
+	struct xpadneo_settings settings;
+	unsigned long overrides;
+};
+
+static DEFINE_MUTEX(standby_lock);
+static LIST_HEAD(standby_list);
+
+static void standby_free(struct xpadneo_standby *standby)
+{
+	int i;
+
+	/* parked devices are always registered */
+	for (i = 0; i < ARRAY_SIZE(standby->idev); i++)
+		if (standby->idev[i])
+			xpadneo_synthetic_destroy(standby->idev[i], true);
+
+	if (standby->id >= 0)
+		xpadneo_core_free_id(standby->id);
+
+	kfree(standby);
+}
+
+static void standby_expire(struct work_struct *work)
+{
+	struct xpadneo_standby *standby =
+	    container_of(to_delayed_work(work), struct xpadneo_standby, expire);
+
+	scoped_guard(mutex, &standby_lock) {
+		/* a reconnect claimed the devices in the mean time */
+		if (list_empty(&standby->node))
+			return;
+		list_del_init(&standby->node);
+	}
+
+	pr_info("hid-xpadneo %s: standby expired, removing devices\n", standby->uniq);
+	standby_free(standby);
+}
+
+static void standby_park_subdevice(struct xpadneo_standby *standby, unsigned int which,
+				   struct xpadneo_subdevice *subdev)
+{
+	struct input_dev *idev = subdev->idev;
+	int ret;
+
+	if (!idev || !subdev->is_synthetic || !subdev->registered)
+		return;
+
+	/* the HID device goes away, keep the input device as a virtual device */
+	ret = device_move(&idev->dev, NULL, DPM_ORDER_NONE);
+	if (ret)
+		return;
+
+	/* pairs with smp_load_acquire() in xpadneo_subdevice_ready() */
+	smp_store_release(&subdev->registered, false);
+	dev_set_drvdata(&idev->dev, NULL);
+	subdev->idev = NULL;
+	subdev->is_synthetic = false;
+	standby->idev[which] = idev;
+}
+
+/*
+ * xpadneo_standby_park - keep the devices of a disconnecting controller
+ *
+ * Takes over the registered synthetic devices, the device id and the per-device
+ * settings, the following remove functions then skip what was parked.
+ */
+void xpadneo_standby_park(struct xpadneo_devdata *xdata)
+{
+	struct hid_device *hdev = xdata->hdev;
+	unsigned int timeout = READ_ONCE(param_standby_timeout);
+	struct xpadneo_standby *standby;
+	const struct xpadneo_config *config;
+
+	if (!timeout || !hdev->uniq[0] || (xdata->id < 0))
+		return;
+
+	standby = kzalloc(sizeof(*standby), GFP_KERNEL);
+	if (!standby)
+		return;
+
+	INIT_LIST_HEAD(&standby->node);
+	INIT_DELAYED_WORK(&standby->expire, standby_expire);
+	strscpy(standby->uniq, hdev->uniq, sizeof(standby->uniq));
+
+	rcu_read_lock();
+	config = rcu_dereference(xdata->config);
+	standby->settings = config->settings;
+	standby->overrides = config->overrides;
+	rcu_read_unlock();
+
+	standby_park_subdevice(standby, XPADNEO_SYNTHETIC_CONSUMER, &xdata->consumer);
+	standby_park_subdevice(standby, XPADNEO_SYNTHETIC_KEYBOARD, &xdata->keyboard);
+	standby_park_subdevice(standby, XPADNEO_SYNTHETIC_MOUSE, &xdata->mouse);
+
+	/* the id keeps the names of the battery and the state page stable */
+	standby->id = xdata->id;
+	xdata->id = -1;
+
+	scoped_guard(mutex, &standby_lock) {
+		list_add(&standby->node, &standby_list);
+	}
+
+	schedule_delayed_work(&standby->expire, msecs_to_jiffies(timeout * MSEC_PER_SEC));
+	hid_info(hdev, "parked devices for %us\n", timeout);
+}
+
+/*
+ * xpadneo_standby_claim - find parked devices of a reconnecting controller
+ *
+ * Returns the device id to reuse, or -ENOENT. The parked devices are adopted
+ * by xpadneo_synthetic_init() and xpadneo_standby_finish() releases the rest.
+ */
+int xpadneo_standby_claim(struct xpadneo_devdata *xdata)
+{
+	struct hid_device *hdev = xdata->hdev;
+	struct xpadneo_standby *standby = NULL, *iter;
+	int id;
+
+	if (!hdev->uniq[0])
+		return -ENOENT;
+
+	scoped_guard(mutex, &standby_lock) {
+		list_for_each_entry(iter, &standby_list, node) {
+			if (!strcmp(iter->uniq, hdev->uniq)) {
+				list_del_init(&iter->node);
+				standby = iter;
+				break;
+			}
+		}
+	}
+
+	if (!standby)
+		return -ENOENT;
+
+	/* the expiry sees the entry unlinked if it is already running */
+	cancel_delayed_work_sync(&standby->expire);
+
+	id = standby->id;
+	standby->id = -1;
+	xdata->standby = standby;
+
+	hid_info(hdev, "reattaching parked devices\n");
+	return id;
+}
+
+/* restore the per-device settings after the configuration was initialized */
+void xpadneo_standby_restore(struct xpadneo_devdata *xdata)
+{
+	struct xpadneo_standby *standby = xdata->standby;
+
+	if (!standby || !standby->overrides)
+		return;
+
+	if (xpadneo_config_restore(xdata, &standby->settings, standby->overrides))
+		hid_err(xdata->hdev, "failed to restore per-device settings\n");
+}
+
+struct input_dev *xpadneo_standby_adopt(struct xpadneo_devdata *xdata, unsigned int which)
+{
+	struct xpadneo_standby *standby = xdata->standby;
+	struct input_dev *idev;
+
+	if (!standby || (which >= ARRAY_SIZE(standby->idev)) || !standby->idev[which])
+		return NULL;
+
+	idev = standby->idev[which];
+	if (device_move(&idev->dev, &xdata->hdev->dev, DPM_ORDER_DEV_LAST))
+		return NULL;
+
+	standby->idev[which] = NULL;
+	return idev;
+}
+
+/* release what the reconnected controller did not adopt */
+void xpadneo_standby_finish(struct xpadneo_devdata *xdata)
+{
+	if (!xdata->standby)
+		return;
+
+	standby_free(xdata->standby);
+	xdata->standby = NULL;
+}
+
+void xpadneo_standby_flush(void)
+{
+	struct xpadneo_standby *standby;
+
+	for (;;) {
+		scoped_guard(mutex, &standby_lock) {
+			standby = list_first_entry_or_null(&standby_list, struct xpadneo_standby,
+							   node);
+			if (standby)
+				list_del_init(&standby->node);
+		}
+
+		if (!standby)
+			break;
+
+		cancel_delayed_work_sync(&standby->expire);
+		standby_free(standby);
+	}
+}
@@ -0,0 +1,315 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo shared controller state page
+ *
+ * Each controller gets a character device /dev/xpadneoN which can be mapped
+ * read-only by applications. The page holds the latest decoded controller
+ * state, so games polling once per frame need no syscalls or wakeups.
+ * Writing to the device streams rumble frames, see uapi.h.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/fs.h>
+#include <linux/kref.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+
+#include "xpadneo.h"
+
+/* always include last */
+#include "compat.h"
+
+/* shared by the device and its open files, so it outlives a disconnect */
+struct xpadneo_state_file {
+	struct kref kref;
+	struct mutex lock;
+	struct xpadneo_devdata *xdata;	/* NULL after disconnect */
+	struct page *page;
+};
+
+static u32 state_button_bit(unsigned int code)
+{
+	switch (code) {
+	case BTN_A:
+		return XPADNEO_STATE_BTN_A;
+	case BTN_B:
+		return XPADNEO_STATE_BTN_B;
+	case BTN_X:
+		return XPADNEO_STATE_BTN_X;
+	case BTN_Y:
+		return XPADNEO_STATE_BTN_Y;
+	case BTN_TL:
+		return XPADNEO_STATE_BTN_LB;
+	case BTN_TR:
+		return XPADNEO_STATE_BTN_RB;
+	case BTN_SELECT:
+		return XPADNEO_STATE_BTN_BACK;
+	case BTN_START:
+		return XPADNEO_STATE_BTN_MENU;
+	case BTN_THUMBL:
+		return XPADNEO_STATE_BTN_LS;
+	case BTN_THUMBR:
+		return XPADNEO_STATE_BTN_RS;
+	case BTN_XBOX:
+		return XPADNEO_STATE_BTN_XBOX;
+	case BTN_SHARE:
+		return XPADNEO_STATE_BTN_SHARE;
+	default:
+		return 0;
+	}
+}
+
+void xpadneo_state_event(struct xpadneo_devdata *xdata, struct hid_usage *usage, s32 value)
+{
+	struct xpadneo_state_data *data = &xdata->state.shadow;
+	u32 bit;
+
+	if (!xdata->state.page)
+		return;
+
+	if (usage->type == EV_KEY) {
+		if (usage->code == BTN_GRIPL) {
+			/* combined paddle usage, see xpadneo_events_event() */
+			data->paddles = value & 0x0F;
+			return;
+		}
+
+		bit = state_button_bit(usage->code);
+		if (value)
+			data->buttons |= bit;
+		else
+			data->buttons &= ~bit;
+	} else if (usage->type == EV_ABS) {
+		switch (usage->code) {
+		case ABS_X:
+			data->left_x = value - 32768;
+			break;
+		case ABS_Y:
+			data->left_y = value - 32768;
+			break;
+		case ABS_RX:
+			data->right_x = value - 32768;
+			break;
+		case ABS_RY:
+			data->right_y = value - 32768;
+			break;
+		case ABS_Z:
+			data->left_trigger = value;
+			break;
+		case ABS_RZ:
+			data->right_trigger = value;
+			break;
+		case ABS_HAT0X:
+			data->dpad = value;
+			break;
+		}
+	}
+}
+
+void xpadneo_state_sticks(struct xpadneo_devdata *xdata, int stick, s32 x, s32 y)
+{
+	struct xpadneo_state_data *data = &xdata->state.shadow;
+
+	/* the sticks were processed, expose the processed position */
+	if (stick == 0) {
+		data->left_x = x;
+		data->left_y = y;
+	} else {
+		data->right_x = x;
+		data->right_y = y;
+	}
+}
+
+void xpadneo_state_report(struct xpadneo_devdata *xdata)
+{
+	struct xpadneo_state_data *data = &xdata->state.shadow;
+	struct xpadneo_state *state = smp_load_acquire(&xdata->state.page);
+	u32 seq;
+
+	if (!state)
+		return;
+
+	data->timestamp_ns = ktime_to_ns(xdata->report_time);
+	data->reports++;
+	data->profile = xdata->profile;
+	data->left_trigger_scale = xdata->trigger_scale.left;
+	data->right_trigger_scale = xdata->trigger_scale.right;
+	data->battery = xdata->battery.flags;
+
+	/* we are the only writer, readers retry while seq is odd or changed */
+	seq = state->seq;
+	WRITE_ONCE(state->seq, seq + 1);
+	smp_wmb();
+	memcpy(&state->data, data, sizeof(state->data));
+	smp_wmb();
+	WRITE_ONCE(state->seq, seq + 2);
+}
+
+/* publish a neutral state for a controller which powers off */
+void xpadneo_state_release(struct xpadneo_devdata *xdata)
+{
+	struct xpadneo_state_data *data = &xdata->state.shadow;
+
+	data->buttons = 0;
+	data->paddles = 0;
+	data->left_x = 0;
+	data->left_y = 0;
+	data->right_x = 0;
+	data->right_y = 0;
+	data->left_trigger = 0;
+	data->right_trigger = 0;
+	data->dpad = 0;
+
+	xpadneo_state_report(xdata);
+}
+
+static void state_free(struct kref *kref)
+{
+	struct xpadneo_state_file *sf = container_of(kref, struct xpadneo_state_file, kref);
+
+	/* mappings keep their own page reference */
+	put_page(sf->page);
+	kfree(sf);
+}
+
+static int state_open(struct inode *inode, struct file *file)
+{
+	struct miscdevice *misc = file->private_data;
+	struct xpadneo_devdata *xdata = container_of(misc, struct xpadneo_devdata, state.misc);
+
+	kref_get(&xdata->state.file->kref);
+	file->private_data = xdata->state.file;
+
+	return 0;
+}
+
+static int state_release(struct inode *inode, struct file *file)
+{
+	struct xpadneo_state_file *sf = file->private_data;
+
+	kref_put(&sf->kref, state_free);
+	return 0;
+}
+
+static ssize_t state_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct xpadneo_state_file *sf = file->private_data;
+	struct xpadneo_rumble_frame frames[XPADNEO_RUMBLE_STREAM_LEN];
+	unsigned int n = min_t(size_t, count / sizeof(frames[0]), ARRAY_SIZE(frames));
+	ssize_t ret;
+
+	if (!n || (count % sizeof(frames[0])))
+		return -EINVAL;
+
+	if (copy_from_user(frames, buf, n * sizeof(frames[0])))
+		return -EFAULT;
+
+	/* the device cannot go away while we hold the lock */
+	scoped_guard(mutex, &sf->lock) {
+		if (!sf->xdata)
+			return -ENODEV;
+
+		ret = xpadneo_rumble_stream(sf->xdata, frames, n);
+	}
+
+	if (ret < 0)
+		return ret;
+
+	return ret * sizeof(frames[0]);
+}
+
+static int state_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct xpadneo_state_file *sf = file->private_data;
+
+	if ((vma->vm_pgoff != 0) || (vma->vm_end - vma->vm_start != PAGE_SIZE))
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vm_flags_clear(vma, VM_MAYWRITE);
+
+	/* the mapping holds its own page reference */
+	return vm_insert_page(vma, vma->vm_start, sf->page);
+}
+
+static const struct file_operations state_fops = {
+	.owner = THIS_MODULE,
+	.open = state_open,
+	.release = state_release,
+	.write = state_write,
+	.mmap = state_mmap,
+	.llseek = noop_llseek,
+};
+
+int xpadneo_state_init(struct xpadneo_devdata *xdata)
+{
+	struct hid_device *hdev = xdata->hdev;
+	struct xpadneo_state_file *sf;
+	struct xpadneo_state *state;
+	int ret;
+
+	sf = kzalloc(sizeof(*sf), GFP_KERNEL);
+	if (!sf)
+		return -ENOMEM;
+
+	sf->page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!sf->page) {
+		kfree(sf);
+		return -ENOMEM;
+	}
+
+	kref_init(&sf->kref);
+	mutex_init(&sf->lock);
+	sf->xdata = xdata;
+	xdata->state.file = sf;
+
+	state = page_address(sf->page);
+	state->magic = XPADNEO_STATE_MAGIC;
+	state->version = XPADNEO_STATE_VERSION;
+	state->size = sizeof(*state);
+
+	snprintf(xdata->state.name, sizeof(xdata->state.name), "xpadneo%d", xdata->id);
+	xdata->state.misc.minor = MISC_DYNAMIC_MINOR;
+	xdata->state.misc.name = xdata->state.name;
+	xdata->state.misc.fops = &state_fops;
+	xdata->state.misc.parent = &hdev->dev;
+
+	ret = misc_register(&xdata->state.misc);
+	if (ret) {
+		hid_err(hdev, "failed to register %s: %d\n", xdata->state.name, ret);
+		xdata->state.file = NULL;
+		kref_put(&sf->kref, state_free);
+		return ret;
+	}
+
+	/* pairs with smp_load_acquire() in xpadneo_state_report() */
+	smp_store_release(&xdata->state.page, state);
+
+	hid_info(hdev, "state page available at /dev/%s\n", xdata->state.name);
+	return 0;
+}
+
+void xpadneo_state_remove(struct xpadneo_devdata *xdata)
+{
+	struct xpadneo_state_file *sf = xdata->state.file;
+
+	if (!sf)
+		return;
+
+	/* existing files and mappings keep the page, but lose the device */
+	misc_deregister(&xdata->state.misc);
+	scoped_guard(mutex, &sf->lock) {
+		sf->xdata = NULL;
+	}
+
+	xdata->state.page = NULL;
+	xdata->state.file = NULL;
+	kref_put(&sf->kref, state_free);
+}
@@ -6,33 +6,79 @@
  * Copyright (c) 2021 Kai Krakow <kai@kaishome.de>
  */
 
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
 #include "xpadneo.h"
 
+static bool param_lazy_subdevices = 1;
+module_param_named(lazy_subdevices, param_lazy_subdevices, bool, 0644);
+MODULE_PARM_DESC(lazy_subdevices,
+		 "(bool) Register the mouse, keyboard and consumer control devices on first use. "
+		 "1: on first use, 0: on connect.");
+
+/*
+ * The strings are owned by the input device rather than the HID device, so
+ * it can be parked across a reconnect, see standby.c.
+ */
+void xpadneo_synthetic_destroy(struct input_dev *input_dev, bool registered)
+{
+	const char *name = input_dev->name;
+	const char *phys = input_dev->phys;
+	const char *uniq = input_dev->uniq;
+
+	if (registered)
+		input_unregister_device(input_dev);
+	else
+		input_free_device(input_dev);
+
+	kfree(name);
+	kfree(phys);
+	kfree(uniq);
+}
+
 int xpadneo_synthetic_init(struct xpadneo_devdata *xdata, const char *suffix,
-			   struct xpadneo_subdevice *subdev)
+			   struct xpadneo_subdevice *subdev, unsigned int which)
 {
 	struct hid_device *hdev = xdata->hdev;
-	struct input_dev *input_dev = devm_input_allocate_device(&hdev->dev);
+	struct input_dev *input_dev;
 	size_t suffix_len, name_len;
 
+	/* take over the device of a previous connection */
+	input_dev = xpadneo_standby_adopt(xdata, which);
+	if (input_dev) {
+		dev_set_drvdata(&input_dev->dev, xdata);
+		subdev->idev = input_dev;
+		subdev->is_synthetic = true;
+		subdev->sync = false;
+
+		/* pairs with smp_load_acquire() in xpadneo_subdevice_ready() */
+		smp_store_release(&subdev->registered, true);
+		hid_info(hdev, "%s reattached\n", suffix);
+		return 0;
+	}
+
+	input_dev = input_allocate_device();
 	if (!input_dev)
 		return -ENOMEM;
 
 	name_len = strlen(hdev->name);
 	suffix_len = strlen(suffix);
-	if ((name_len < suffix_len) || strcmp(hdev->name + name_len - suffix_len, suffix)) {
-		char *name = devm_kasprintf(&hdev->dev, GFP_KERNEL, "%s %s", hdev->name, suffix);
-
-		if (!name)
-			return -ENOMEM;
-		input_dev->name = name;
-	} else {
-		input_dev->name = hdev->name;
+	if ((name_len < suffix_len) || strcmp(hdev->name + name_len - suffix_len, suffix))
+		input_dev->name = kasprintf(GFP_KERNEL, "%s %s", hdev->name, suffix);
+	else
+		input_dev->name = kstrdup(hdev->name, GFP_KERNEL);
+	input_dev->phys = kstrdup(hdev->phys, GFP_KERNEL);
+	input_dev->uniq = kstrdup(hdev->uniq, GFP_KERNEL);
+
+	if (!input_dev->name || !input_dev->phys || !input_dev->uniq) {
+		xpadneo_synthetic_destroy(input_dev, false);
+		return -ENOMEM;
 	}
 
 	dev_set_drvdata(&input_dev->dev, xdata);
-	input_dev->phys = hdev->phys;
-	input_dev->uniq = hdev->uniq;
+	input_dev->dev.parent = &hdev->dev;
 	input_dev->id.bustype = hdev->bus;
 	input_dev->id.vendor = hdev->vendor;
 	input_dev->id.product = hdev->product;
@@ -40,6 +86,7 @@ int xpadneo_synthetic_init(struct xpadneo_devdata *xdata, const char *suffix,
 
 	subdev->idev = input_dev;
 	subdev->is_synthetic = true;
+	subdev->registered = false;
 	subdev->sync = false;
 
 	return 0;
@@ -51,16 +98,20 @@ int xpadneo_synthetic_register(struct xpadneo_devdata *xdata, const char *name,
 	struct hid_device *hdev = xdata->hdev;
 
 	/* register the device on our behalf if synthetic */
-	if (subdev->is_synthetic) {
+	if (subdev->is_synthetic && !subdev->registered) {
 		int ret = input_register_device(subdev->idev);
 
+		/*
+		 * The event path and the timers use the device without a lock,
+		 * so it stays allocated but unregistered until removal.
+		 */
 		if (ret) {
 			hid_err(hdev, "failed to register %s\n", name);
-			subdev->idev = NULL;
-			subdev->is_synthetic = false;
 			return ret;
 		}
 
+		/* pairs with smp_load_acquire() in xpadneo_subdevice_ready() */
+		smp_store_release(&subdev->registered, true);
 		hid_info(hdev, "%s added\n", name);
 	}
 	return 0;
@@ -73,9 +124,35 @@ void xpadneo_synthetic_remove(struct xpadneo_devdata *xdata, const char *name,
 
 	/* unregister the device on our behalf if synthetic */
 	if (subdev->idev && subdev->is_synthetic) {
-		input_unregister_device(subdev->idev);
+		xpadneo_synthetic_destroy(subdev->idev, subdev->registered);
+		if (subdev->registered)
+			hid_info(hdev, "%s removed\n", name);
 		subdev->idev = NULL;
 		subdev->is_synthetic = false;
-		hid_info(hdev, "%s removed\n", name);
+		subdev->registered = false;
 	}
 }
+
+void xpadneo_synthetic_request(struct xpadneo_devdata *xdata, unsigned long mask)
+{
+	unsigned int bit;
+
+	/* requests stay set, so this schedules the worker only once per device */
+	if ((READ_ONCE(xdata->subdevices_requested) & mask) == mask)
+		return;
+
+	for_each_set_bit(bit, &mask, BITS_PER_LONG)
+		set_bit(bit, &xdata->subdevices_requested);
+
+	/* input_register_device() may sleep, so we cannot register from the event path */
+	schedule_work(&xdata->subdevices_worker);
+}
+
+void xpadneo_synthetic_request_eager(struct xpadneo_devdata *xdata)
+{
+	if (param_lazy_subdevices)
+		return;
+
+	xpadneo_synthetic_request(xdata, BIT(XPADNEO_SYNTHETIC_CONSUMER)
+				  | BIT(XPADNEO_SYNTHETIC_KEYBOARD) | BIT(XPADNEO_SYNTHETIC_MOUSE));
+}
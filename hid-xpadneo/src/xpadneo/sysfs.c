@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo sysfs attributes
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/device.h>
+#include <linux/hid.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+
+#include "xpadneo.h"
+
+/* list the detected capabilities, separated by sep */
+static int sysfs_format_capabilities(const struct xpadneo_devdata *xdata, char *buf, size_t size,
+				     char sep)
+{
+	const struct {
+		const char *name;
+		bool set;
+	} caps[] = {
+		{ "share_button", xdata->capabilities.share_button },
+		{ "paddles", xdata->capabilities.paddles },
+		{ "hw_profiles", xdata->capabilities.hw_profiles },
+		{ "uses_hogp", xdata->uses_hogp },
+	};
+	int len = 0;
+
+	buf[0] = '\0';
+	for (int i = 0; i < ARRAY_SIZE(caps); i++) {
+		if (!caps[i].set)
+			continue;
+		if (len)
+			len += scnprintf(buf + len, size - len, "%c", sep);
+		len += scnprintf(buf + len, size - len, "%s", caps[i].name);
+	}
+
+	return len;
+}
+
+/* the identity of the controller before we presented it as an Xbox 360 controller */
+static ssize_t original_vendor_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%04x\n", to_xpadneo_devdata(dev)->original_vendor);
+}
+static DEVICE_ATTR_RO(original_vendor);
+
+static ssize_t original_product_show(struct device *dev, struct device_attribute *attr,
+				     char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%04x\n", to_xpadneo_devdata(dev)->original_product);
+}
+static DEVICE_ATTR_RO(original_product);
+
+static ssize_t original_version_show(struct device *dev, struct device_attribute *attr,
+				     char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%04x\n", to_xpadneo_devdata(dev)->original_version);
+}
+static DEVICE_ATTR_RO(original_version);
+
+static ssize_t descriptor_crc16_show(struct device *dev, struct device_attribute *attr,
+				     char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%04x\n", to_xpadneo_devdata(dev)->original_crc16);
+}
+static DEVICE_ATTR_RO(descriptor_crc16);
+
+static ssize_t capabilities_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	int len = sysfs_format_capabilities(to_xpadneo_devdata(dev), buf, PAGE_SIZE - 1, ' ');
+
+	buf[len++] = '\n';
+	return len;
+}
+static DEVICE_ATTR_RO(capabilities);
+
+static ssize_t quirks_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(to_xpadneo_devdata(dev)->quirks));
+}
+static DEVICE_ATTR_RO(quirks);
+
+static ssize_t probe_timing_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct xpadneo_devdata *xdata = to_xpadneo_devdata(dev);
+	int len = 0;
+
+	static const char *const phase_names[XPADNEO_PROBE_PHASE_NUM] = {
+		[XPADNEO_PROBE_PARSE] = "parse",
+		[XPADNEO_PROBE_HW_START] = "hw_start",
+		[XPADNEO_PROBE_BASE] = "base",
+		[XPADNEO_PROBE_RUMBLE] = "rumble",
+		[XPADNEO_PROBE_SUBDEVICES] = "subdevices",
+		[XPADNEO_PROBE_TOTAL] = "total",
+		[XPADNEO_PROBE_REGISTER] = "register",
+	};
+
+	/* microseconds per phase, "register" runs deferred after "total" */
+	for (int i = 0; i < XPADNEO_PROBE_PHASE_NUM; i++)
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s %lld\n", phase_names[i],
+				 ktime_to_us(xdata->probe.phase[i]));
+
+	return len;
+}
+static DEVICE_ATTR_RO(probe_timing);
+
+static ssize_t axis_filter_stats_show(struct device *dev, struct device_attribute *attr,
+				      char *buf)
+{
+	struct xpadneo_devdata *xdata = to_xpadneo_devdata(dev);
+
+	/* axis events seen by the filter, and how many of them were not reported */
+	return scnprintf(buf, PAGE_SIZE, "received %lu\nsuppressed %lu\n",
+			 READ_ONCE(xdata->axis_filter.received),
+			 READ_ONCE(xdata->axis_filter.suppressed));
+}
+static DEVICE_ATTR_RO(axis_filter_stats);
+
+static struct attribute *xpadneo_attrs[] = {
+	&dev_attr_probe_timing.attr,
+	&dev_attr_axis_filter_stats.attr,
+	&dev_attr_original_vendor.attr,
+	&dev_attr_original_product.attr,
+	&dev_attr_original_version.attr,
+	&dev_attr_descriptor_crc16.attr,
+	&dev_attr_capabilities.attr,
+	&dev_attr_quirks.attr,
+	NULL
+};
+
+static const struct attribute_group xpadneo_attr_group = {
+	.attrs = xpadneo_attrs,
+};
+
+static const struct attribute_group *xpadneo_attr_groups[] = {
+	&xpadneo_attr_group,
+	&xpadneo_config_attr_group,
+	NULL
+};
+
+/*
+ * The add event of the HID device was sent before we knew the controller, so
+ * announce the identity with a change event: udev keeps its properties in the
+ * device database, and enumeration needs no hidraw access.
+ */
+static void sysfs_announce(struct xpadneo_devdata *xdata)
+{
+	char vendor[32], product[32], version[32], crc16[32], quirks[32], caps[64];
+	char *envp[] = { vendor, product, version, crc16, quirks, caps, NULL };
+	int len;
+
+	snprintf(vendor, sizeof(vendor), "XPADNEO_ORIGINAL_VENDOR=%04x", xdata->original_vendor);
+	snprintf(product, sizeof(product), "XPADNEO_ORIGINAL_PRODUCT=%04x",
+		 xdata->original_product);
+	snprintf(version, sizeof(version), "XPADNEO_ORIGINAL_VERSION=%04x",
+		 xdata->original_version);
+	snprintf(crc16, sizeof(crc16), "XPADNEO_DESCRIPTOR_CRC16=%04x", xdata->original_crc16);
+	snprintf(quirks, sizeof(quirks), "XPADNEO_QUIRKS=%u", xdata->quirks);
+
+	len = scnprintf(caps, sizeof(caps), "XPADNEO_CAPABILITIES=");
+	sysfs_format_capabilities(xdata, caps + len, sizeof(caps) - len, ',');
+
+	kobject_uevent_env(&xdata->hdev->dev.kobj, KOBJ_CHANGE, envp);
+}
+
+int xpadneo_sysfs_init(struct xpadneo_devdata *xdata)
+{
+	struct hid_device *hdev = xdata->hdev;
+	int ret = sysfs_create_groups(&hdev->dev.kobj, xpadneo_attr_groups);
+
+	if (ret)
+		hid_err(hdev, "failed to create sysfs attributes: %d\n", ret);
+	else
+		sysfs_announce(xdata);
+
+	return ret;
+}
+
+void xpadneo_sysfs_remove(struct xpadneo_devdata *xdata)
+{
+	sysfs_remove_groups(&xdata->hdev->dev.kobj, xpadneo_attr_groups);
+}
@@ -0,0 +1,347 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/*
+ * xpadneo turbo buttons and macros
+ *
+ * Turbo buttons tap themselves while held, macros tap a sequence of buttons
+ * once when their button is pressed. A per-device timer plays the taps, so
+ * their timing neither depends on the reports of the controller nor on the
+ * load of user space.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "xpadneo.h"
+
+/* always include last */
+#include "compat.h"
+
+/* input codes of the buttons in the order of the button bits */
+static const u16 turbo_codes[XPADNEO_REMAP_BUTTONS] = {
+	BTN_A, BTN_B, BTN_X, BTN_Y, BTN_TL, BTN_TR, BTN_SELECT, BTN_START, BTN_THUMBL, BTN_THUMBR,
+};
+
+static int turbo_index(unsigned int code)
+{
+	for (int i = 0; i < ARRAY_SIZE(turbo_codes); i++)
+		if (turbo_codes[i] == code)
+			return i;
+
+	return -EINVAL;
+}
+
+/* macros can also tap the Share button */
+static int turbo_step_button(const char *name)
+{
+	if (strcasecmp(name, "share") == 0)
+		return XPADNEO_TURBO_SHARE;
+
+	return xpadneo_remap_button(name);
+}
+
+/* parse "<button>[@<rate>]" or "<button>=<button>[+<button> ...][@<rate>]" */
+static int turbo_parse_item(char *item, struct xpadneo_turbo_sequence *seqs)
+{
+	struct xpadneo_turbo_sequence seq = { .repeat = true };
+	char *rate = strchr(item, '@'), *steps, *step;
+	unsigned int hz = XPADNEO_TURBO_RATE_DEFAULT;
+	int button, index;
+
+	if (rate) {
+		*rate++ = '\0';
+		if (kstrtouint(rate, 10, &hz) ||
+		    (hz < XPADNEO_TURBO_RATE_MIN) || (hz > XPADNEO_TURBO_RATE_MAX))
+			return -EINVAL;
+	}
+
+	steps = strchr(item, '=');
+	if (steps)
+		*steps++ = '\0';
+
+	button = xpadneo_remap_button(item);
+	if (button < 0)
+		return -EINVAL;
+
+	if (!steps) {
+		seq.steps[seq.len++] = button;
+	} else {
+		seq.repeat = false;
+		while ((step = strsep(&steps, "+"))) {
+			index = turbo_step_button(step);
+			if ((index < 0) || (seq.len >= XPADNEO_TURBO_STEPS_MAX))
+				return -EINVAL;
+			seq.steps[seq.len++] = index;
+		}
+	}
+
+	seq.half_period = ns_to_ktime(NSEC_PER_SEC / (2 * hz));
+	seqs[button] = seq;
+	return 0;
+}
+
+/* parse "<profile>:<item>[,<item> ...]" */
+static int turbo_parse_profile(char *s, struct xpadneo_turbo *turbo)
+{
+	char *items = strchr(s, ':'), *item;
+	u8 profile;
+	int ret;
+
+	if (!items)
+		return -EINVAL;
+	*items++ = '\0';
+
+	if (kstrtou8(s, 10, &profile) || (profile >= XPADNEO_XBE2_PROFILES_MAX))
+		return -EINVAL;
+
+	while ((item = strsep(&items, ","))) {
+		ret = turbo_parse_item(item, turbo->seq[profile]);
+		if (ret)
+			return ret;
+	}
+
+	turbo->active |= BIT(profile);
+	return 0;
+}
+
+/*
+ * xpadneo_turbo_compile - compile turbo buttons and macros per profile
+ * @spec:  "<profile>:<item>[,<item> ...] ..." with profile 0 to 3, an item is
+ *         either a turbo button "<button>[@<rate>]", or a macro
+ *         "<button>=<button>[+<button> ...][@<rate>]"
+ * @turbo: receives the sequences, or NULL to only validate the spec
+ *
+ * Buttons are a, b, x, y, lb, rb, back, menu, ls, rs, macros can also tap
+ * share. The rate is in taps per second. Returns 0, or -EINVAL if the spec is
+ * invalid.
+ */
+int xpadneo_turbo_compile(const char *spec, struct xpadneo_turbo *turbo)
+{
+	struct xpadneo_turbo *parsed;
+	char *buf, *args, *arg;
+	int ret = 0;
+
+	if (strnlen(spec, XPADNEO_TURBO_SPEC_LEN) >= XPADNEO_TURBO_SPEC_LEN)
+		return -EINVAL;
+
+	buf = kstrdup(spec, GFP_KERNEL);
+	parsed = kzalloc(sizeof(*parsed), GFP_KERNEL);
+	if (!buf || !parsed) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	args = strim(buf);
+	while (!ret && (arg = strsep(&args, " \t"))) {
+		if (*arg)
+			ret = turbo_parse_profile(arg, parsed);
+	}
+
+	if (!ret && turbo)
+		*turbo = *parsed;
+
+out:
+	kfree(parsed);
+	kfree(buf);
+	return ret;
+}
+
+/* report one edge of a tap, returns the sub device to sync */
+static struct xpadneo_subdevice *turbo_report(struct xpadneo_devdata *xdata, u8 button,
+					      bool pressed)
+{
+	if (button == XPADNEO_TURBO_SHARE) {
+		/* the Share button lives on the keyboard, register it on first use */
+		if (!xpadneo_subdevice_ready(&xdata->keyboard)) {
+			if (pressed)
+				xpadneo_synthetic_request(xdata, BIT(XPADNEO_SYNTHETIC_KEYBOARD));
+			return NULL;
+		}
+		input_report_key(xdata->keyboard.idev, BTN_SHARE, pressed);
+		return &xdata->keyboard;
+	}
+
+	if (!xdata->gamepad.idev)
+		return NULL;
+
+	input_report_key(xdata->gamepad.idev, turbo_codes[button], pressed);
+	return &xdata->gamepad;
+}
+
+/* play the next edge of a sequence, called with the lock held */
+static struct xpadneo_subdevice *turbo_step(struct xpadneo_devdata *xdata, int button,
+					    ktime_t now)
+{
+	struct xpadneo_turbo_player *player = &xdata->turbo.player[button];
+	struct xpadneo_subdevice *subdev;
+
+	subdev = turbo_report(xdata, player->seq.steps[player->step / 2], !(player->step & 1));
+
+	/* keep the rate without drift, but do not catch up on missed taps */
+	player->next = ktime_add(player->next, player->seq.half_period);
+	if (ktime_before(player->next, now))
+		player->next = ktime_add(now, player->seq.half_period);
+
+	if (++player->step >= 2 * player->seq.len) {
+		player->step = 0;
+		if (!player->seq.repeat)
+			__clear_bit(button, &xdata->turbo.running);
+	}
+
+	return subdev;
+}
+
+/* release a button still pressed by the sequence, called with the lock held */
+static struct xpadneo_subdevice *turbo_halt(struct xpadneo_devdata *xdata, int button)
+{
+	struct xpadneo_turbo_player *player = &xdata->turbo.player[button];
+
+	__clear_bit(button, &xdata->turbo.running);
+	if (!(player->step & 1))
+		return NULL;
+
+	return turbo_report(xdata, player->seq.steps[player->step / 2], false);
+}
+
+/* wake up for the earliest edge, called with the lock held */
+static void turbo_arm(struct xpadneo_devdata *xdata)
+{
+	ktime_t next = KTIME_MAX;
+	int button;
+
+	if (!xdata->turbo.running)
+		return;
+
+	for_each_set_bit(button, &xdata->turbo.running, XPADNEO_REMAP_BUTTONS)
+		next = min(next, xdata->turbo.player[button].next);
+
+	hrtimer_start(&xdata->turbo.timer, next, HRTIMER_MODE_ABS_SOFT);
+}
+
+static enum hrtimer_restart turbo_timer(struct hrtimer *t)
+{
+	struct xpadneo_devdata *xdata = container_of(t, struct xpadneo_devdata, turbo.timer);
+	struct xpadneo_subdevice *subdev;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	int button;
+
+	spin_lock_irqsave(&xdata->turbo.lock, flags);
+	for_each_set_bit(button, &xdata->turbo.running, XPADNEO_REMAP_BUTTONS) {
+		if (ktime_before(now, xdata->turbo.player[button].next))
+			continue;
+
+		subdev = turbo_step(xdata, button, now);
+		if (subdev)
+			input_sync(subdev->idev);
+	}
+
+	/* restarting from here also wins over a concurrent start from the event path */
+	turbo_arm(xdata);
+	spin_unlock_irqrestore(&xdata->turbo.lock, flags);
+
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * xpadneo_turbo_event - play turbo buttons and macros of the current profile
+ *
+ * The first tap is reported with the current report, the timer plays the
+ * others. Every report repeats the state of all buttons, so only changes of
+ * the button start or stop a sequence. Returns 1 if the button was consumed.
+ */
+int xpadneo_turbo_event(struct xpadneo_devdata *xdata, struct hid_usage *usage, s32 value)
+{
+	struct xpadneo_turbo_sequence seq = { };
+	struct xpadneo_subdevice *subdev = NULL;
+	struct xpadneo_turbo_player *player;
+	const struct xpadneo_turbo *turbo;
+	unsigned long flags;
+	bool running, changed;
+	int button;
+
+	if (usage->type != EV_KEY)
+		return 0;
+
+	button = turbo_index(usage->code);
+	if (button < 0)
+		return 0;
+
+	rcu_read_lock();
+	turbo = &rcu_dereference(xdata->config)->turbo;
+	if (unlikely(turbo->active & BIT(xdata->profile)))
+		seq = turbo->seq[xdata->profile][button];
+	rcu_read_unlock();
+
+	spin_lock_irqsave(&xdata->turbo.lock, flags);
+	if (value)
+		changed = !__test_and_set_bit(button, &xdata->turbo.held);
+	else
+		changed = __test_and_clear_bit(button, &xdata->turbo.held);
+
+	running = test_bit(button, &xdata->turbo.running);
+	if (!xdata->turbo.enabled || (!seq.len && !running)) {
+		spin_unlock_irqrestore(&xdata->turbo.lock, flags);
+		return 0;
+	}
+
+	/* a macro plays until its end, a turbo button until released */
+	player = &xdata->turbo.player[button];
+	if (changed && value && !running) {
+		player->seq = seq;
+		player->step = 0;
+		player->next = ktime_get();
+		__set_bit(button, &xdata->turbo.running);
+		subdev = turbo_step(xdata, button, player->next);
+		turbo_arm(xdata);
+	} else if (changed && !value && running && player->seq.repeat) {
+		subdev = turbo_halt(xdata, button);
+	}
+	spin_unlock_irqrestore(&xdata->turbo.lock, flags);
+
+	if (subdev)
+		subdev->sync = true;
+
+	return 1;
+}
+
+/* stop all sequences and release their buttons */
+void xpadneo_turbo_stop(struct xpadneo_devdata *xdata)
+{
+	struct xpadneo_subdevice *subdev;
+	unsigned long flags;
+	int button;
+
+	spin_lock_irqsave(&xdata->turbo.lock, flags);
+	for_each_set_bit(button, &xdata->turbo.running, XPADNEO_REMAP_BUTTONS) {
+		subdev = turbo_halt(xdata, button);
+		if (subdev)
+			input_sync(subdev->idev);
+	}
+	spin_unlock_irqrestore(&xdata->turbo.lock, flags);
+
+	hrtimer_try_to_cancel(&xdata->turbo.timer);
+}
+
+void xpadneo_turbo_init_timer(struct xpadneo_devdata *xdata)
+{
+	spin_lock_init(&xdata->turbo.lock);
+	hrtimer_setup(&xdata->turbo.timer, turbo_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+	xdata->turbo.enabled = true;
+}
+
+void xpadneo_turbo_remove_timer(struct xpadneo_devdata *xdata)
+{
+	unsigned long flags;
+
+	/* the input devices go away, do not report anything anymore */
+	spin_lock_irqsave(&xdata->turbo.lock, flags);
+	xdata->turbo.enabled = false;
+	xdata->turbo.running = 0;
+	spin_unlock_irqrestore(&xdata->turbo.lock, flags);
+
+	hrtimer_cancel(&xdata->turbo.timer);
+}
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-2.0-only WITH Linux-syscall-note */
+
+/*
+ * xpadneo userspace interface
+ *
+ * Layouts shared with userspace through the per-device character device
+ * /dev/xpadneoN. This header is self-contained so applications can copy it.
+ *
+ * Copyright (c) 2026 Kai Krakow <kai@kaishome.de>
+ */
+
+#ifndef XPADNEO_UAPI_H
+#define XPADNEO_UAPI_H
+
+#include <linux/types.h>
+
+#define XPADNEO_STATE_MAGIC   0x78706e73	/* "xpns" */
+#define XPADNEO_STATE_VERSION 1
+
+/* bits of xpadneo_state_data.buttons */
+#define XPADNEO_STATE_BTN_A      (1 << 0)
+#define XPADNEO_STATE_BTN_B      (1 << 1)
+#define XPADNEO_STATE_BTN_X      (1 << 2)
+#define XPADNEO_STATE_BTN_Y      (1 << 3)
+#define XPADNEO_STATE_BTN_LB     (1 << 4)
+#define XPADNEO_STATE_BTN_RB     (1 << 5)
+#define XPADNEO_STATE_BTN_BACK   (1 << 6)
+#define XPADNEO_STATE_BTN_MENU   (1 << 7)
+#define XPADNEO_STATE_BTN_LS     (1 << 8)
+#define XPADNEO_STATE_BTN_RS     (1 << 9)
+#define XPADNEO_STATE_BTN_XBOX   (1 << 10)
+#define XPADNEO_STATE_BTN_SHARE  (1 << 11)
+
+/* bits of xpadneo_state_data.paddles */
+#define XPADNEO_STATE_PADDLE_P1  (1 << 0)
+#define XPADNEO_STATE_PADDLE_P2  (1 << 1)
+#define XPADNEO_STATE_PADDLE_P3  (1 << 2)
+#define XPADNEO_STATE_PADDLE_P4  (1 << 3)
+
+/* xpadneo_state_data.battery is the battery byte reported by the controller */
+#define XPADNEO_STATE_BATTERY_LEVEL(b)    ((b) & 0x03)
+#define XPADNEO_STATE_BATTERY_MODE(b)     (((b) >> 2) & 0x03)	/* 0: USB, 1: battery, 2: PnC */
+#define XPADNEO_STATE_BATTERY_CHARGING(b) (((b) & 0x10) != 0)
+#define XPADNEO_STATE_BATTERY_ONLINE(b)   (((b) & 0x80) != 0)
+
+struct xpadneo_state_data {
+	__u64 timestamp_ns;	/* CLOCK_MONOTONIC receive time of the last report */
+	__u32 reports;		/* number of reports received */
+	__u32 buttons;		/* XPADNEO_STATE_BTN_* */
+	__s16 left_x, left_y;	/* -32768 to 32767, after the driver's stick processing */
+	__s16 right_x, right_y;
+	__u16 left_trigger;	/* 0 to 1023 */
+	__u16 right_trigger;
+	__u8 dpad;		/* 0: centered, 1: up, then clockwise to 8: up-left */
+	__u8 paddles;		/* XPADNEO_STATE_PADDLE_* */
+	__u8 profile;		/* 0 to 3 */
+	__u8 left_trigger_scale;	/* 0: full, 1: half, 2: digital */
+	__u8 right_trigger_scale;
+	__u8 battery;
+	__u8 reserved[2];
+};
+
+/*
+ * Mapped read-only at offset 0 of /dev/xpadneoN. The data is protected by a
+ * sequence counter: it is odd while the driver updates the data. Readers load
+ * seq (acquire), copy the data, issue a read barrier, and retry if seq was
+ * odd or has changed.
+ */
+struct xpadneo_state {
+	__u32 magic;
+	__u16 version;
+	__u16 size;		/* sizeof(struct xpadneo_state) */
+	__u32 seq;
+	__u32 reserved;
+	struct xpadneo_state_data data;
+};
+
+/*
+ * Written to /dev/xpadneoN opened for writing, one or more frames per write.
+ * Magnitudes use the full 16 bit range as with FF_RUMBLE, the trigger motors
+ * are not scaled by trigger pressure. Frames with a timestamp of 0 or in the
+ * past are applied immediately, others at the given CLOCK_MONOTONIC time.
+ * Timestamps must increase within a stream: an earlier timestamp starts a new
+ * stream, dropping frames still queued. Attenuation settings still apply.
+ */
+struct xpadneo_rumble_frame {
+	__u64 timestamp_ns;
+	__u16 strong, weak;
+	__u16 left, right;
+};
+
+/* frames queued at most, a write accepts at most this many frames */
+#define XPADNEO_RUMBLE_STREAM_LEN 16
+
+#endif
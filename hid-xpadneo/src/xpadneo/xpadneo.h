@@ -14,12 +14,19 @@
 #define XPADNEO_H
 
 #include <linux/hid.h>
+#include <linux/hrtimer.h>
 #include <linux/input.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/miscdevice.h>
 #include <linux/power_supply.h>
+#include <linux/rcupdate.h>
 #include <linux/spinlock.h>
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 
+#include "uapi.h"
+
 /* detect locally administered unicast MAC addresses */
 #define XPADNEO_OUI_IS_MULTICAST       (1 << 0)
 #define XPADNEO_OUI_IS_LAA             (1 << 1)
@@ -65,6 +72,205 @@ enum xpadneo_trigger_scale {
 	XBOX_TRIGGER_SCALE_NUM
 } __packed;
 
+/* probe phases recorded for the timing breakdown */
+enum xpadneo_probe_phase {
+	XPADNEO_PROBE_PARSE,
+	XPADNEO_PROBE_HW_START,
+	XPADNEO_PROBE_BASE,
+	XPADNEO_PROBE_RUMBLE,
+	XPADNEO_PROBE_SUBDEVICES,
+	XPADNEO_PROBE_TOTAL,
+	XPADNEO_PROBE_REGISTER,
+	XPADNEO_PROBE_PHASE_NUM
+};
+
+/* synthetic sub devices requested for registration */
+#define XPADNEO_SYNTHETIC_CONSUMER    0
+#define XPADNEO_SYNTHETIC_KEYBOARD    1
+#define XPADNEO_SYNTHETIC_MOUSE       2
+#define XPADNEO_SYNTHETIC_REPLAY_SHARE 3
+
+/* response curves map stick deflection through a lookup table */
+#define XPADNEO_CURVE_MAX      32768
+#define XPADNEO_CURVE_BITS     9
+#define XPADNEO_CURVE_SIZE     (1 << XPADNEO_CURVE_BITS)
+#define XPADNEO_CURVE_SHIFT    (15 - XPADNEO_CURVE_BITS)
+#define XPADNEO_CURVE_SPEC_LEN 128
+
+struct xpadneo_curve {
+	char spec[XPADNEO_CURVE_SPEC_LEN];
+	u16 lut[XPADNEO_CURVE_SIZE + 1];
+};
+
+/* module parameter "trigger_rumble_mode" */
+#define PARAM_TRIGGER_RUMBLE_PRESSURE 0
+#define PARAM_TRIGGER_RUMBLE_RESERVED 1
+#define PARAM_TRIGGER_RUMBLE_DISABLE  2
+
+/* rumble output report budget, rate in reports per second */
+#define XPADNEO_RUMBLE_REPORT_RATE_MAX 1000
+#define XPADNEO_RUMBLE_REPORT_BURST    4
+
+/* mouse mode report rate limits in Hz */
+#define XPADNEO_MOUSE_REPORT_RATE_MIN 50
+#define XPADNEO_MOUSE_REPORT_RATE_MAX 1000
+
+/* XBE2 controllers support four profiles */
+#define XPADNEO_XBE2_PROFILES_MAX 4
+
+/* per-profile button maps cover the buttons before the Xbox button */
+#define XPADNEO_REMAP_BUTTONS  10
+#define XPADNEO_REMAP_SPEC_LEN 128
+
+struct xpadneo_remap {
+	u8 active;		/* profiles with a button map */
+	u16 lut[XPADNEO_XBE2_PROFILES_MAX][2][256];
+};
+
+/* turbo buttons and macros, tap rates in Hz */
+#define XPADNEO_TURBO_SPEC_LEN     128
+#define XPADNEO_TURBO_STEPS_MAX    8
+#define XPADNEO_TURBO_SHARE        XPADNEO_REMAP_BUTTONS
+#define XPADNEO_TURBO_RATE_MIN     1
+#define XPADNEO_TURBO_RATE_MAX     50
+#define XPADNEO_TURBO_RATE_DEFAULT 10
+
+struct xpadneo_turbo_sequence {
+	bool repeat;		/* turbo button, taps itself while held */
+	u8 len;
+	u8 steps[XPADNEO_TURBO_STEPS_MAX];
+	ktime_t half_period;
+};
+
+struct xpadneo_turbo {
+	u8 active;		/* profiles with turbo buttons or macros */
+	struct xpadneo_turbo_sequence seq[XPADNEO_XBE2_PROFILES_MAX][XPADNEO_REMAP_BUTTONS];
+};
+
+/* a turbo button or macro being played */
+struct xpadneo_turbo_player {
+	struct xpadneo_turbo_sequence seq;
+	u8 step;		/* tap times two, odd while the button is pressed */
+	ktime_t next;
+};
+
+/* upper limit of the Xbox button chord window in ms */
+#define XPADNEO_SHIFT_WINDOW_MAX 1000
+
+/* module parameter "stick_mode" */
+#define PARAM_STICK_MODE_OFF           0
+#define PARAM_STICK_MODE_RADIAL        1
+#define PARAM_STICK_MODE_SCALED_RADIAL 2
+
+/* settings which can be overridden per device */
+enum xpadneo_config_field {
+	XPADNEO_CONFIG_RUMBLE_ATTENUATION,
+	XPADNEO_CONFIG_TRIGGER_RUMBLE_MODE,
+	XPADNEO_CONFIG_RUMBLE_DEADBAND,
+	XPADNEO_CONFIG_RUMBLE_REPORT_RATE,
+	XPADNEO_CONFIG_DISABLE_DEADZONES,
+	XPADNEO_CONFIG_DISABLE_SHIFT_MODE,
+	XPADNEO_CONFIG_SHIFT_WINDOW,
+	XPADNEO_CONFIG_TRIGGER_MODE,
+	XPADNEO_CONFIG_MOUSE_REPORT_RATE,
+	XPADNEO_CONFIG_MOUSE_DEADZONE,
+	XPADNEO_CONFIG_MOUSE_CURVE,
+	XPADNEO_CONFIG_STICK_MODE,
+	XPADNEO_CONFIG_STICK_DEADZONE,
+	XPADNEO_CONFIG_STICK_ANTI_DEADZONE,
+	XPADNEO_CONFIG_STICK_CURVE,
+	XPADNEO_CONFIG_AXIS_FILTER,
+	XPADNEO_CONFIG_AXIS_FILTER_MIN_CUTOFF,
+	XPADNEO_CONFIG_AXIS_FILTER_BETA,
+	XPADNEO_CONFIG_BUTTON_MAP,
+	XPADNEO_CONFIG_TURBO_MAP,
+	XPADNEO_CONFIG_FIELD_NUM
+};
+
+struct xpadneo_settings {
+	u8 rumble_attenuation[2];
+	u8 trigger_rumble_mode;
+	u8 rumble_deadband;
+	u32 rumble_report_rate;
+	bool disable_deadzones;
+	bool disable_shift_mode;
+	u32 shift_window;
+	u8 trigger_mode[2];
+	u32 mouse_report_rate;
+	u16 mouse_deadzone;
+	char mouse_curve[XPADNEO_CURVE_SPEC_LEN];
+	u8 stick_mode;
+	u16 stick_deadzone;
+	u16 stick_anti_deadzone;
+	char stick_curve[XPADNEO_CURVE_SPEC_LEN];
+	bool axis_filter;
+	u32 axis_filter_min_cutoff;
+	u32 axis_filter_beta;
+	char button_map[XPADNEO_REMAP_SPEC_LEN];
+	char turbo_map[XPADNEO_TURBO_SPEC_LEN];
+};
+
+/* immutable once published, replaced as a whole when a setting changes */
+struct xpadneo_config {
+	struct rcu_head rcu;
+	struct xpadneo_settings settings;
+	unsigned long overrides;
+
+	/* Q32 scale factors from 16 bit magnitudes (and trigger pressure) to 0..100 */
+	u32 rumble_main_scale;
+	u32 rumble_trigger_scale;
+
+	/* smallest motor change worth a report, and the time budget per report (0: unlimited) */
+	u8 rumble_deadband;
+	ktime_t rumble_interval;
+
+	/* time to wait for a chord before the Xbox button press is reported, 0: until release */
+	ktime_t shift_window;
+
+	/* clamped mouse report rate and the resulting timer period */
+	u32 mouse_rate;
+	ktime_t mouse_period;
+
+	/* mouse speed by stick magnitude, with dead zone and curve */
+	u16 mouse_lut[XPADNEO_CURVE_SIZE + 1];
+
+	/* thumb stick output magnitude by input magnitude, with dead zones and curve */
+	u16 stick_lut[XPADNEO_CURVE_SIZE + 1];
+
+	/* button bit permutation per profile */
+	struct xpadneo_remap button_remap;
+
+	/* turbo buttons and macros per profile */
+	struct xpadneo_turbo turbo;
+};
+
+/* Xbox button chord detection in shift mode */
+enum xpadneo_shift_state {
+	XPADNEO_SHIFT_IDLE,	/* no window, or waiting for the release */
+	XPADNEO_SHIFT_WAIT,	/* press withheld, waiting for a chord */
+	XPADNEO_SHIFT_CHORD,	/* a chord was used, swallow the button */
+	XPADNEO_SHIFT_EMITTED	/* no chord in time, the press was reported */
+};
+
+/* results of the axis jitter filter */
+enum xpadneo_filter_result {
+	XPADNEO_FILTER_BYPASS,
+	XPADNEO_FILTER_PASS,
+	XPADNEO_FILTER_SUPPRESS
+};
+
+/* state of the axis jitter filter, Q8 fixed-point in stick units */
+struct xpadneo_axis_filter {
+	bool valid;
+	ktime_t time;
+	s64 x_hat, dx_hat;
+	s32 in, out;
+
+	/* replayed to settle the output when the controller stops reporting */
+	struct hid_field *field;
+	struct hid_usage *usage;
+};
+
 #define XPADNEO_MISSING_CONSUMER 1
 #define XPADNEO_MISSING_GAMEPAD  2
 #define XPADNEO_MISSING_KEYBOARD 4
@@ -110,6 +316,7 @@ struct xpadneo_subdevice {
 	struct input_dev *idev;
 	bool sync;
 	bool is_synthetic;
+	bool registered;
 };
 
 /* private driver instance data */
@@ -126,6 +333,11 @@ struct xpadneo_devdata {
 	struct xpadneo_subdevice keyboard;
 	struct xpadneo_subdevice mouse;
 
+	/* deferred registration of synthetic sub devices */
+	struct work_struct subdevices_worker;
+	unsigned long subdevices_requested;
+	bool share_held;
+
 	short int missing_reported;
 
 	/* revert fixups on removal */
@@ -135,12 +347,15 @@ struct xpadneo_devdata {
 
 	/* quirk flags */
 	unsigned int original_rsize;
+	u16 original_crc16;
 	u32 quirks;
 	u32 device_flags;
 
 	/* profile switching */
 	bool shift_mode, profile_switched;
 	u8 last_profile, profile;
+	u8 shift_state;
+	struct hrtimer shift_timer;
 
 	/* detected device capabilities */
 	struct {
@@ -152,12 +367,34 @@ struct xpadneo_devdata {
 	/* HOGP protocol */
 	bool uses_hogp;
 
+	/* transport driver wrapped for output arbitration, and the task sending our reports */
+	const struct hid_ll_driver *ll_driver;
+	struct hid_ll_driver ll_arbiter;
+	struct task_struct *output_owner;
+
+	/* per-device configuration */
+	struct xpadneo_config __rcu *config;
+	struct list_head config_node;
+
+	/* parked devices of a previous connection, only set during probe */
+	struct xpadneo_standby *standby;
+
+	/* quiesced for system sleep, protected by the device lock */
+	bool suspended;
+
+	/* the controller announced to power off, inputs are released */
+	bool shutdown;
+
 	/* mouse mode */
 	bool mouse_mode;
-	struct timer_list mouse_timer;
+	struct hrtimer mouse_timer;
 	struct {
+		bool ticking;
+		u32 rate;
+		ktime_t period;
 		s32 rel_x, rel_y, wheel_x, wheel_y;
 		s32 rel_x_err, rel_y_err, wheel_x_err, wheel_y_err;
+		s32 wheel_x_hi_res, wheel_y_hi_res;
 		struct {
 			bool left, right;
 		} analog_button;
@@ -177,6 +414,14 @@ struct xpadneo_devdata {
 		char *name_pnc;
 		u8 report_id;
 		u8 flags;
+
+		/* debounced flags and capacity estimate, read by the power supply */
+		spinlock_t lock;
+		struct hrtimer timer;
+		u8 published;
+		u8 capacity, capacity_notified;
+		ktime_t level_entered;
+		u64 level_ns_per_percent;
 	} battery;
 
 	/* duplicate report buffers */
@@ -186,34 +431,169 @@ struct xpadneo_devdata {
 	s32 last_abs_z;
 	s32 last_abs_rz;
 
+	/* receive time of the current input report */
+	ktime_t report_time;
+
+	/* software digital trigger mode, left and right trigger past the press threshold */
+	bool trigger_pressed[2];
+
+	/* axis jitter filter for sticks and triggers */
+	struct {
+		/* serializes the settle timer with the event callbacks */
+		spinlock_t lock;
+		struct xpadneo_axis_filter axes[6];
+		struct hrtimer settle_timer;
+		unsigned long received, suppressed;
+	} axis_filter;
+
+	/* turbo buttons and macros being played, protected by the lock */
+	struct {
+		spinlock_t lock;
+		struct hrtimer timer;
+		bool enabled;
+		unsigned long held, running;
+		struct xpadneo_turbo_player player[XPADNEO_REMAP_BUTTONS];
+	} turbo;
+
+	/* shared state page */
+	struct {
+		struct miscdevice misc;
+		char name[16];
+		struct xpadneo_state_file *file;
+		struct xpadneo_state *page;
+		struct xpadneo_state_data shadow;
+	} state;
+
+	/* thumb stick positions cached for processing per report */
+	struct {
+		s32 x[2], y[2];
+		bool pending;
+	} sticks;
+
+	/* probe timing breakdown */
+	struct {
+		ktime_t start;
+		ktime_t phase[XPADNEO_PROBE_PHASE_NUM];
+	} probe;
+
 	/* buffer for rumble_worker */
 	struct {
 		spinlock_t lock;
 		struct work_struct worker;
 		struct work_struct init_worker;
-		bool enabled, pending;
+		bool enabled, pending, resume, settle;
 		struct xpadneo_rumble_data data;
 		struct xpadneo_rumble_data shadow;
 		void *output_report_dmabuf;
+		struct hrtimer stream_timer;
+		struct xpadneo_rumble_frame stream[XPADNEO_RUMBLE_STREAM_LEN];
+		u8 stream_head, stream_len;
+		struct hrtimer defer_timer;
+		ktime_t budget_tat;
+		enum xpadneo_rumble_motors click;
+		u8 click_magnitude;
 	} rumble;
 };
 
 /* xpadneo helpers for synthetic drivers */
 extern int xpadneo_synthetic_init(struct xpadneo_devdata *, const char *,
-				  struct xpadneo_subdevice *);
+				  struct xpadneo_subdevice *, unsigned int);
+extern void xpadneo_synthetic_destroy(struct input_dev *, bool);
 extern int xpadneo_synthetic_register(struct xpadneo_devdata *, const char *,
 				      struct xpadneo_subdevice *);
 extern void xpadneo_synthetic_remove(struct xpadneo_devdata *, const char *,
 				     struct xpadneo_subdevice *);
+extern void xpadneo_synthetic_request(struct xpadneo_devdata *, unsigned long);
+extern void xpadneo_synthetic_request_eager(struct xpadneo_devdata *);
+
+/* xpadneo hot-standby across short disconnects */
+extern void xpadneo_standby_park(struct xpadneo_devdata *);
+extern int xpadneo_standby_claim(struct xpadneo_devdata *);
+extern void xpadneo_standby_restore(struct xpadneo_devdata *);
+extern struct input_dev *xpadneo_standby_adopt(struct xpadneo_devdata *, unsigned int);
+extern void xpadneo_standby_finish(struct xpadneo_devdata *);
+extern void xpadneo_standby_flush(void);
+
+static inline bool xpadneo_subdevice_ready(const struct xpadneo_subdevice *subdev)
+{
+	/* hid-core registers non-synthetic devices itself */
+	return subdev->idev && (!subdev->is_synthetic || smp_load_acquire(&subdev->registered));
+}
+
+/* xpadneo per-device configuration */
+extern int xpadneo_config_init(struct xpadneo_devdata *);
+extern int xpadneo_config_restore(struct xpadneo_devdata *, const struct xpadneo_settings *,
+				  unsigned long);
+extern void xpadneo_config_remove(struct xpadneo_devdata *);
+extern const struct attribute_group xpadneo_config_attr_group;
+
+static inline bool xpadneo_config_flat_disabled(const struct xpadneo_settings *settings)
+{
+	/* the stick processing handles dead zones itself */
+	return settings->disable_deadzones || (settings->stick_mode != PARAM_STICK_MODE_OFF);
+}
+
+/* xpadneo response curves */
+extern struct xpadneo_curve *xpadneo_curve_create(const char *, u16);
+
+static inline s32 xpadneo_curve_lookup(const u16 *lut, s32 value)
+{
+	u32 index = min_t(u32, abs(value), XPADNEO_CURVE_MAX) >> XPADNEO_CURVE_SHIFT;
+
+	return value < 0 ? -lut[index] : lut[index];
+}
+
+/* xpadneo per-profile button maps */
+extern int xpadneo_remap_button(const char *);
+extern int xpadneo_remap_compile(const char *, struct xpadneo_remap *);
+
+/* xpadneo turbo buttons and macros */
+extern int xpadneo_turbo_compile(const char *, struct xpadneo_turbo *);
+extern void xpadneo_turbo_init_timer(struct xpadneo_devdata *);
+extern int xpadneo_turbo_event(struct xpadneo_devdata *, struct hid_usage *, s32);
+extern void xpadneo_turbo_stop(struct xpadneo_devdata *);
+extern void xpadneo_turbo_remove_timer(struct xpadneo_devdata *);
+
+/* xpadneo axis jitter filter */
+extern void xpadneo_filter_init_timer(struct xpadneo_devdata *);
+extern enum xpadneo_filter_result xpadneo_filter_axis(struct xpadneo_devdata *, struct hid_field *,
+						      struct hid_usage *, s32 *);
+extern void xpadneo_filter_reset(struct xpadneo_devdata *);
+extern void xpadneo_filter_remove_timer(struct xpadneo_devdata *);
+
+/* xpadneo shared state page */
+extern int xpadneo_state_init(struct xpadneo_devdata *);
+extern void xpadneo_state_event(struct xpadneo_devdata *, struct hid_usage *, s32);
+extern void xpadneo_state_sticks(struct xpadneo_devdata *, int, s32, s32);
+extern void xpadneo_state_report(struct xpadneo_devdata *);
+extern void xpadneo_state_release(struct xpadneo_devdata *);
+extern void xpadneo_state_remove(struct xpadneo_devdata *);
+
+/* xpadneo sysfs attributes */
+static inline struct xpadneo_devdata *to_xpadneo_devdata(struct device *dev)
+{
+	return hid_get_drvdata(to_hid_device(dev));
+}
+
+extern int xpadneo_sysfs_init(struct xpadneo_devdata *);
+extern void xpadneo_sysfs_remove(struct xpadneo_devdata *);
 
 /* xpadneo descriptor debug helpers */
 extern void xpadneo_debug_hid_report(const struct hid_device *, const void *, const size_t);
-extern void xpadneo_debug_descriptor(const struct hid_device *, const __u8 *, unsigned int);
+extern u16 xpadneo_debug_descriptor(const struct hid_device *, const __u8 *, unsigned int);
+
+/* xpadneo driver core */
+extern void xpadneo_core_free_id(int);
+extern void xpadneo_core_power_off(struct xpadneo_devdata *);
+extern void xpadneo_core_power_on(struct xpadneo_devdata *);
 
 /* xpadneo core device functions */
 extern void xpadneo_device_report(struct hid_device *, struct hid_report *);
+extern void xpadneo_device_report_locked(struct xpadneo_devdata *);
 extern void xpadneo_device_missing(struct xpadneo_devdata *, u32);
 extern int xpadneo_device_output_report(struct hid_device *, __u8 *, size_t, bool);
+extern void xpadneo_device_arbitrate(struct xpadneo_devdata *);
+extern void xpadneo_device_arbitrate_remove(struct xpadneo_devdata *);
 extern const __u8 *xpadneo_device_report_fixup(struct hid_device *hdev, __u8 *rdesc,
 					       unsigned int *rsize);
 
@@ -231,23 +611,41 @@ extern int xpadneo_rumble_init_workqueue(void);
 extern void xpadneo_rumble_destroy_workqueue(void);
 extern inline void xpadneo_rumble_streaming_set(struct xpadneo_devdata *, const bool);
 extern inline bool xpadneo_rumble_streaming_get(const struct xpadneo_devdata *);
+extern ssize_t xpadneo_rumble_stream(struct xpadneo_devdata *, const struct xpadneo_rumble_frame *,
+				     unsigned int);
+extern int xpadneo_rumble_merge(struct xpadneo_devdata *, const struct xpadneo_rumble_data *);
+extern void xpadneo_rumble_click(struct xpadneo_devdata *, enum xpadneo_rumble_motors,
+				 unsigned int);
+extern void xpadneo_rumble_suspend(struct xpadneo_devdata *);
+extern void xpadneo_rumble_resume(struct xpadneo_devdata *);
+extern void xpadneo_rumble_shutdown(struct xpadneo_devdata *);
 extern void xpadneo_rumble_remove(struct xpadneo_devdata *);
 
 /* xpadneo mouse driver */
 extern int xpadneo_mouse_init(struct xpadneo_devdata *);
 extern void xpadneo_mouse_init_timer(struct xpadneo_devdata *);
-extern void xpadneo_mouse_report(struct timer_list *);
 extern bool xpadneo_mouse_toggle(struct xpadneo_devdata *);
 extern int xpadneo_mouse_event(struct xpadneo_devdata *, struct hid_usage *, __s32);
 extern int xpadneo_mouse_raw_event(struct xpadneo_devdata *, struct hid_report *, u8 *, int);
+extern void xpadneo_mouse_stop(struct xpadneo_devdata *);
 extern void xpadneo_mouse_remove_timer(struct xpadneo_devdata *);
 extern void xpadneo_mouse_remove(struct xpadneo_devdata *);
 
 /* battery and power functions */
 extern int xpadneo_power_init(struct xpadneo_devdata *);
+extern void xpadneo_power_init_timer(struct xpadneo_devdata *);
 extern void xpadneo_power_update(struct xpadneo_devdata *, u8);
+extern void xpadneo_power_remove_timer(struct xpadneo_devdata *);
 extern void xpadneo_power_remove(struct xpadneo_devdata *);
 
+/* per-controller state cache */
+extern void xpadneo_cache_invalidate(void);
+extern bool xpadneo_cache_get_quirks(struct xpadneo_devdata *, u32, u32 *);
+extern void xpadneo_cache_put_quirks(struct xpadneo_devdata *, u32);
+extern void xpadneo_cache_put_state(struct xpadneo_devdata *);
+extern void xpadneo_cache_restore_state(struct xpadneo_devdata *);
+extern void xpadneo_cache_flush(void);
+
 /* driver quirks handling */
 extern int xpadneo_quirks_init(struct xpadneo_devdata *);
 extern void xpadneo_quirks_remove(struct xpadneo_devdata *);
@@ -259,6 +657,13 @@ extern int xpadneo_mappings_input(struct hid_device *, struct hid_input *,
 /* driver events and profiles handling */
 extern int xpadneo_events_raw_event(struct hid_device *, struct hid_report *, u8 *, int);
 extern int xpadneo_events_event(struct hid_device *, struct hid_field *, struct hid_usage *, __s32);
+extern int xpadneo_events_event_locked(struct hid_device *, struct hid_field *, struct hid_usage *,
+				       __s32);
 extern int xpadneo_events_input_configured(struct hid_device *, struct hid_input *);
+extern void xpadneo_events_update_deadzones(struct xpadneo_devdata *, bool);
+extern void xpadneo_events_report(struct xpadneo_devdata *);
+extern void xpadneo_events_release(struct xpadneo_devdata *);
+extern void xpadneo_events_init_timer(struct xpadneo_devdata *);
+extern void xpadneo_events_remove_timer(struct xpadneo_devdata *);
 
 #endif
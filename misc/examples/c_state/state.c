@@ -0,0 +1,60 @@
+/* state page test, polls the controller state without any syscalls
+ * usage: ./state /dev/xpadneo0
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "uapi.h"
+
+static void read_state(const volatile struct xpadneo_state *state, struct xpadneo_state_data *data)
+{
+	__u32 seq;
+
+	do {
+		seq = __atomic_load_n(&state->seq, __ATOMIC_ACQUIRE);
+		*data = *(const struct xpadneo_state_data *)&state->data;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || (seq != __atomic_load_n(&state->seq, __ATOMIC_RELAXED)));
+}
+
+int main(int argc, char **argv)
+{
+	const struct xpadneo_state *state;
+	struct xpadneo_state_data data;
+	struct timespec frame = { .tv_nsec = 16666667 };
+	int fd;
+
+	fd = open(argc > 1 ? argv[1] : "/dev/xpadneo0", O_RDONLY);
+	if (fd < 0) {
+		perror("open");
+		return EXIT_FAILURE;
+	}
+
+	state = mmap(NULL, sizeof(*state), PROT_READ, MAP_SHARED, fd, 0);
+	if (state == MAP_FAILED) {
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+
+	if ((state->magic != XPADNEO_STATE_MAGIC) || (state->version != XPADNEO_STATE_VERSION)) {
+		fprintf(stderr, "unsupported state page version %u\n", state->version);
+		return EXIT_FAILURE;
+	}
+
+	/* simulate a game polling once per frame */
+	for (;;) {
+		read_state(state, &data);
+		printf("\rreports %8u buttons %04x left %6d %6d right %6d %6d triggers %4u %4u dpad %u",
+		       data.reports, data.buttons, data.left_x, data.left_y, data.right_x,
+		       data.right_y, data.left_trigger, data.right_trigger, data.dpad);
+		fflush(stdout);
+		nanosleep(&frame, NULL);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* HID-BPF version of XPADNEO_QUIRK_NINTENDO: swap A with B, and X with Y
+ *
+ * Adjust the vendor and product ids below to your controller. If the driver
+ * also applies the quirk to your controller (e.g. 8BitDo), remove it with the
+ * quirks module parameter, e.g. quirks=E4:17:D8:11:22:33-32, or the buttons
+ * are swapped back. Build and install it with udev-hid-bpf.
+ */
+
+#include "vmlinux.h"
+#include "hid_bpf.h"
+#include "hid_bpf_helpers.h"
+#include <bpf/bpf_tracing.h>
+
+#define VID_MICROSOFT 0x045E
+#define PID_XBOX_ONE_S 0x02FD
+
+HID_BPF_CONFIG(
+	HID_DEVICE(BUS_BLUETOOTH, HID_GROUP_GENERIC, VID_MICROSOFT, PID_XBOX_ONE_S),
+);
+
+#define RDESC_MAX 4096
+
+/* Linux mode firmware reports X and Y one bit higher until the driver fixes it up */
+static bool linux_buttons;
+
+static __u8 swap_bits(__u8 value, int a, int b)
+{
+	__u8 x = ((value >> a) ^ (value >> b)) & 1;
+
+	return value ^ ((x << a) | (x << b));
+}
+
+/* only detect the button layout, the driver applies its fixups after us */
+SEC(HID_BPF_RDESC_FIXUP)
+int BPF_PROG(nintendo_rdesc_fixup, struct hid_bpf_ctx *hctx)
+{
+	__u8 *rdesc = hid_bpf_get_data(hctx, 0, RDESC_MAX);
+
+	if (!rdesc || (hctx->size < 164))
+		return 0;
+
+	linux_buttons = rdesc[140] == 0x05 && rdesc[141] == 0x09 &&
+	    rdesc[144] == 0x29 && rdesc[145] == 0x0F &&
+	    rdesc[152] == 0x95 && rdesc[153] == 0x0F;
+
+	return 0;
+}
+
+SEC(HID_BPF_DEVICE_EVENT)
+int BPF_PROG(nintendo_device_event, struct hid_bpf_ctx *hctx)
+{
+	__u8 *data = hid_bpf_get_data(hctx, 0, 15);
+
+	if (!data || (data[0] != 0x01) || (hctx->size < 15))
+		return 0;
+
+	/* runs before the driver, so this works on the firmware layout */
+	data[14] = swap_bits(data[14], 0, 1);
+	if (linux_buttons)
+		data[14] = swap_bits(data[14], 3, 4);
+	else
+		data[14] = swap_bits(data[14], 2, 3);
+
+	return 0;
+}
+
+HID_BPF_OPS(nintendo_layout) = {
+	.hid_rdesc_fixup = (void *)nintendo_rdesc_fixup,
+	.hid_device_event = (void *)nintendo_device_event,
+};
+
+SEC("syscall")
+int probe(struct hid_bpf_probe_args *ctx)
+{
+	ctx->retval = ctx->rdesc_size >= 81 ? 0 : -EINVAL;
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* HID-BPF version of the xpadneo descriptor and button layout fixups
+ *
+ * Load with the module parameter report_fixups=0, then adjust this program
+ * instead of patching the driver. Build and install it with udev-hid-bpf:
+ * copy it to src/bpf/testing/ of its source tree, and run the install step.
+ *
+ * The driver only patches unmodified descriptors, so if this program is
+ * loaded while report_fixups=1, the driver skips what was fixed up here.
+ */
+
+#include "vmlinux.h"
+#include "hid_bpf.h"
+#include "hid_bpf_helpers.h"
+#include <bpf/bpf_tracing.h>
+
+#define VID_MICROSOFT 0x045E
+
+#define PID_XBOX_ONE_S       0x02E0
+#define PID_XBOX_ONE_S_2     0x02FD
+#define PID_XBOX_ONE_S_BLE   0x0B20
+#define PID_XBOX_ELITE_2     0x0B05
+#define PID_XBOX_ELITE_2_BLE 0x0B22
+#define PID_XBOX_SERIES      0x0B13
+
+HID_BPF_CONFIG(
+	HID_DEVICE(BUS_BLUETOOTH, HID_GROUP_GENERIC, VID_MICROSOFT, PID_XBOX_ONE_S),
+	HID_DEVICE(BUS_BLUETOOTH, HID_GROUP_GENERIC, VID_MICROSOFT, PID_XBOX_ONE_S_2),
+	HID_DEVICE(BUS_BLUETOOTH, HID_GROUP_GENERIC, VID_MICROSOFT, PID_XBOX_ONE_S_BLE),
+	HID_DEVICE(BUS_BLUETOOTH, HID_GROUP_GENERIC, VID_MICROSOFT, PID_XBOX_ELITE_2),
+	HID_DEVICE(BUS_BLUETOOTH, HID_GROUP_GENERIC, VID_MICROSOFT, PID_XBOX_ELITE_2_BLE),
+	HID_DEVICE(BUS_BLUETOOTH, HID_GROUP_GENERIC, VID_MICROSOFT, PID_XBOX_SERIES),
+);
+
+#define RDESC_MAX 4096
+
+/* set when the button layout of the Linux mode firmware was fixed up */
+static bool linux_buttons;
+
+static bool has_share_button(const struct hid_bpf_ctx *hctx)
+{
+	switch (hctx->hid->product) {
+	case PID_XBOX_ONE_S_BLE:
+	case PID_XBOX_ELITE_2_BLE:
+	case PID_XBOX_SERIES:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* same fixups as xpadneo_device_report_fixup() */
+SEC(HID_BPF_RDESC_FIXUP)
+int BPF_PROG(xpadneo_rdesc_fixup, struct hid_bpf_ctx *hctx)
+{
+	__u8 *rdesc = hid_bpf_get_data(hctx, 0, RDESC_MAX);
+	__u32 size = hctx->size;
+
+	if (!rdesc || (size < 2) || (size > RDESC_MAX))
+		return 0;
+
+	/* fixup trailing NUL byte */
+	if ((rdesc[(size - 2) & (RDESC_MAX - 1)] == 0xC0)
+	    && (rdesc[(size - 1) & (RDESC_MAX - 1)] == 0x00))
+		size--;
+
+	/* fixup reported axes for Xbox One S */
+	if (size >= 81) {
+		if (rdesc[34] == 0x09 && rdesc[35] == 0x32)
+			rdesc[35] = 0x33;	/* Z --> Rx */
+		if (rdesc[36] == 0x09 && rdesc[37] == 0x35)
+			rdesc[37] = 0x34;	/* Rz --> Ry */
+		if (rdesc[52] == 0x05 && rdesc[53] == 0x02 && rdesc[54] == 0x09 && rdesc[55] == 0xC5) {
+			rdesc[53] = 0x01;	/* Simulation -> Gendesk */
+			rdesc[55] = 0x32;	/* Brake -> Z */
+		}
+		if (rdesc[77] == 0x05 && rdesc[78] == 0x02 && rdesc[79] == 0x09 && rdesc[80] == 0xC4) {
+			rdesc[78] = 0x01;	/* Simulation -> Gendesk */
+			rdesc[80] = 0x35;	/* Accelerator -> Rz */
+		}
+	}
+
+	/* 12 buttons instead of 15 for Xbox controllers in Linux mode */
+	if (size >= 164) {
+		if (rdesc[140] == 0x05 && rdesc[141] == 0x09 &&
+		    rdesc[144] == 0x29 && rdesc[145] == 0x0F &&
+		    rdesc[152] == 0x95 && rdesc[153] == 0x0F &&
+		    rdesc[162] == 0x95 && rdesc[163] == 0x01) {
+			linux_buttons = true;
+			rdesc[145] = 0x0C;	/* 15 buttons -> 12 buttons */
+			rdesc[153] = 0x0C;	/* 15 bits -> 12 bits buttons */
+			rdesc[163] = 0x04;	/* 1 bit -> 4 bits constants */
+		}
+	}
+
+	return size != hctx->size ? size : 0;
+}
+
+/* same button shuffle as XPADNEO_QUIRK_LINUX_BUTTONS in xpadneo_events_raw_event() */
+SEC(HID_BPF_DEVICE_EVENT)
+int BPF_PROG(xpadneo_device_event, struct hid_bpf_ctx *hctx)
+{
+	__u8 *data = hid_bpf_get_data(hctx, 0, 17);
+	__u16 bits = 0;
+
+	if (!data || !linux_buttons || (data[0] != 0x01) || (hctx->size < 17))
+		return 0;
+
+	bits |= (data[14] & (BIT(0) | BIT(1))) >> 0;	/* A, B */
+	bits |= (data[14] & (BIT(3) | BIT(4))) >> 1;	/* X, Y */
+	bits |= (data[14] & (BIT(6) | BIT(7))) >> 2;	/* LB, RB */
+	if (has_share_button(hctx))
+		bits |= (data[15] & BIT(2)) << 4;	/* Back */
+	else
+		bits |= (data[16] & BIT(0)) << 6;	/* Back */
+	bits |= (data[15] & BIT(3)) << 4;	/* Menu */
+	bits |= (data[15] & BIT(5)) << 3;	/* LS */
+	bits |= (data[15] & BIT(6)) << 3;	/* RS */
+	bits |= (data[15] & BIT(4)) << 6;	/* Xbox */
+	if (has_share_button(hctx))
+		bits |= (data[16] & BIT(0)) << 11;	/* Share */
+	data[14] = (__u8)((bits >> 0) & 0xFF);
+	data[15] = (__u8)((bits >> 8) & 0xFF);
+	data[16] = 0;
+
+	return 0;
+}
+
+HID_BPF_OPS(xpadneo_fixups) = {
+	.hid_rdesc_fixup = (void *)xpadneo_rdesc_fixup,
+	.hid_device_event = (void *)xpadneo_device_event,
+};
+
+SEC("syscall")
+int probe(struct hid_bpf_probe_args *ctx)
+{
+	/* only attach to the gamepad descriptor */
+	ctx->retval = ctx->rdesc_size >= 81 ? 0 : -EINVAL;
+	return 0;
+}
+
+char _license[] SEC("license") = "GPL";